@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# builds the vault benchmark and replays the same workload under each allocation policy
+# usage: ./bench.sh <work_dir> [extra vault_bench options]
+
+WORK_DIR=${1:-/tmp/vault_bench}
+shift
+
+gcc -o vault_bench vault_bench.c vault_aux.c vault_catalog.c vault_files.c vault_crc.c vault_stats.c -lpthread -lm || exit 1
+
+for POLICY in bestfit nextfit segregated; do
+    echo "=== $POLICY ==="
+    rm -rf $WORK_DIR
+    ./vault_bench $WORK_DIR 4M 2000 -s 1K:256K -d loguniform -r 0.35 -f 0.15 -p $POLICY "$@"
+done
+rm -rf $WORK_DIR
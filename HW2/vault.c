@@ -9,6 +9,7 @@
 #include "vault_catalog.h"
 #include "vault_files.h"
 #include "vault_consts.h"
+#include "vault_stats.h"
 
 
 int main (int argc, char** argv) {
@@ -22,6 +23,18 @@ int main (int argc, char** argv) {
 	gettimeofday(&start_time, NULL);
 	/*** timing code end ***/
 
+	// remove statistics flag from arguments
+	int showStats = 0;
+	for (int i=1; i < argc; i++) {
+		if (streq(argv[i], STATS_FLAG)) {
+			showStats = 1;
+			for (int j=i; j < argc-1; j++)
+				argv[j] = argv[j+1];
+			argc--;
+			break;
+		}
+	}
+
 	// command to lowercase
 	if (argc >= 3) strToLower(argv[2]);
 
@@ -38,20 +51,25 @@ int main (int argc, char** argv) {
 			printf(INIT_SIZE_ERR);
 
 		else {
-			// parse size
+			// parse size and allocation policy (best fit by default)
 			ssize_t vaultSize = parseSize(argv[3]);
+			short allocPolicy = (argc < 5) ? ALLOC_BEST_FIT : parseAllocPolicy(argv[4]);
 			if (vaultSize <= 0)
 				printf(INIT_SIZE_ERR);
+			else if (allocPolicy == -1)
+				printf(INIT_POLICY_ERR);
 
 			// run init
 			else
-				res = initVault(argv[1], vaultSize);
+				res = initVault(argv[1], vaultSize, allocPolicy);
 		}
 	}
 
 	else if (streq(argv[2],LIST_CMND) || streq(argv[2],ADD_CMND) ||
 			 streq(argv[2],RM_CMND) || streq(argv[2],FETCH_CMND) ||
-			 streq(argv[2],DEFRAG_CMND) || streq(argv[2],STATUS_CMND)) {
+			 streq(argv[2],DEFRAG_CMND) || streq(argv[2],STATUS_CMND) ||
+			 streq(argv[2],GROW_CMND) || streq(argv[2],SHRINK_CMND) ||
+			 streq(argv[2],VERIFY_CMND)) {
 
 		char msg[1024] = "";
 
@@ -69,7 +87,7 @@ int main (int argc, char** argv) {
 
 		/*** GET VAULT STATUS ***/
 		else if (streq(argv[2],STATUS_CMND))
-			res = getVaultStatus(catalog);
+			res = getVaultStatus(catalog, vaultFd);
 
 		/*** MANIPULATE VAULT FILES ***/
 		else if (streq(argv[2],ADD_CMND) || streq(argv[2],RM_CMND) || streq(argv[2],FETCH_CMND)) {
@@ -83,13 +101,32 @@ int main (int argc, char** argv) {
 			else if (streq(argv[2],RM_CMND))
 				res = rmVaultFile(argv[3], vaultFd, catalog, &updateCatalog, msg);
 			else if (streq(argv[2],FETCH_CMND))
-				res = fetchVaultFile(argv[3], vaultFd, catalog, msg);
+				res = fetchVaultFile(argv[3], vaultFd, catalog,
+						argc >= 5 && streq(argv[4],VERIFY_FLAG), msg);
 		}
 
 		/*** DEFRAG VAULT ***/
 		else if (streq(argv[2],DEFRAG_CMND))
 			res = defragVault(argv[1], vaultFd, catalog, &updateCatalog, msg);
 
+		/*** VERIFY VAULT ***/
+		else if (streq(argv[2],VERIFY_CMND))
+			res = verifyVault(vaultFd, catalog, msg);
+
+		/*** RESIZE VAULT ***/
+		else if (streq(argv[2],GROW_CMND) || streq(argv[2],SHRINK_CMND)) {
+			// validate arguments and parse size
+			ssize_t resizeSize = (argc < 4) ? 0 : parseSize(argv[3]);
+			if (resizeSize <= 0)
+				printf(RESIZE_SIZE_ERR);
+
+			// run command
+			else if (streq(argv[2],GROW_CMND))
+				res = growVault(resizeSize, vaultFd, catalog, &updateCatalog, msg);
+			else
+				res = shrinkVault(argv[1], resizeSize, vaultFd, catalog, &updateCatalog, msg);
+		}
+
 		// close vault
 		if (closeVault(vaultFd, catalog, updateCatalog) == -1)
 			res = -1;
@@ -111,5 +148,9 @@ int main (int argc, char** argv) {
 	printf("Elapsed time: %.3f milliseconds\n", mtime);
 	/*** timing code end ***/
 
+	// per phase breakdown
+	if (showStats)
+		printStats();
+
 	return res;
 }
@@ -1,12 +1,16 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <fcntl.h>
 #include <errno.h>
 
 #include "vault_aux.h"
 #include "vault_consts.h"
+#include "vault_crc.h"
+#include "vault_stats.h"
 
 /* Check if two strings are equal */
 int streq(char* str1, char* str2) {
@@ -76,9 +80,12 @@ void formatSize(char* sizeStr, ssize_t psize) {
 }
 
 /* Copies data from one file descriptor to another through a buffer */
-int copyData (int fromFd, int toFd, ssize_t dataSize) {
+int copyData (int fromFd, int toFd, ssize_t dataSize, unsigned int* crc) {
 	ssize_t writeSize = 0, bufferSize = BUFFER_SIZE, tmpSize;
 	char buffer[BUFFER_SIZE];
+	double startTime = statsStart();
+	if (crc != NULL)
+		*crc = 0;
 
 	while (writeSize < dataSize) {
 		// don't read more than you can write
@@ -86,14 +93,18 @@ int copyData (int fromFd, int toFd, ssize_t dataSize) {
 			bufferSize = dataSize - writeSize ;
 
 		// read data
-		tmpSize = read(fromFd, buffer, bufferSize);
+		tmpSize = statsRead(fromFd, buffer, bufferSize);
 		if (tmpSize != bufferSize) {
 			printf(DATA_READ_ERR, strerror(errno));
 			return -1;
 		}
 
+		// update checksum
+		if (crc != NULL)
+			*crc = crc32c(*crc, buffer, bufferSize);
+
 		// write data
-		tmpSize = write(toFd, buffer, bufferSize);
+		tmpSize = statsWrite(toFd, buffer, bufferSize);
 		if (tmpSize != bufferSize) {
 			printf(DATA_WRITE_ERR, strerror(errno));
 			return -1;
@@ -102,5 +113,28 @@ int copyData (int fromFd, int toFd, ssize_t dataSize) {
 		writeSize += bufferSize;
 	}
 
+	statsEnd(PHASE_PAYLOAD_COPY, startTime);
 	return 0;
 }
+
+/* Allocates disk space for a range of a file (file size is not changed) */
+int allocateData(int fd, off_t offset, off_t length) {
+	if (length <= 0 || statsFallocate(fd, FALLOC_FL_KEEP_SIZE, offset, length) == 0)
+		return 0;
+
+	// file system does not support allocation - space is allocated on write
+	if (errno == EOPNOTSUPP || errno == ENOSYS)
+		return 0;
+	return -1;
+}
+
+/* Releases disk space of a range of a file, leaving a hole that reads as zeros */
+int punchHole(int fd, off_t offset, off_t length) {
+	if (length <= 0 || statsFallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0)
+		return 0;
+
+	// file system does not support holes - data is left in place
+	if (errno == EOPNOTSUPP || errno == ENOSYS)
+		return 0;
+	return -1;
+}
@@ -36,16 +36,41 @@ ssize_t parseSize(char* sizeStr);
 void formatSize(char* sizeStr, ssize_t psize);
 
 /* Copies data from one file descriptor to another through a buffer
+ * Optionally computes CRC32C checksum of the data while copying.
  *
  * @param fromFd - file descriptor of file to copy from
  * 				   must be open for read and set to correct offset
  * @param toFd - file descriptor of file to copy to
  * 				 must be open for write and set to correct offset
  * @param dataSize - amount of data to copy in bytes
+ * @param crc - return parameter - checksum of copied data
+ * 				NULL to skip checksum
  *
  * @return 0 for success, -1 for failure
  */
-int copyData (int fromFd, int toFd, ssize_t dataSize);
+int copyData (int fromFd, int toFd, ssize_t dataSize, unsigned int* crc);
 
+/* Allocates disk space for a range of a file (file size is not changed).
+ * Does nothing if the file system does not support allocation.
+ *
+ * @param fd - file descriptor of file - must be open for write
+ * @param offset - start of range in bytes
+ * @param length - length of range in bytes
+ *
+ * @return 0 for success, -1 for failure
+ */
+int allocateData(int fd, off_t offset, off_t length);
+
+/* Releases disk space of a range of a file, leaving a hole that reads as
+ * zeros (file size is not changed).
+ * Does nothing if the file system does not support hole punching.
+ *
+ * @param fd - file descriptor of file - must be open for write
+ * @param offset - start of range in bytes
+ * @param length - length of range in bytes
+ *
+ * @return 0 for success, -1 for failure
+ */
+int punchHole(int fd, off_t offset, off_t length);
 
 #endif /* VAULT_AUX_H_ */
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "vault_aux.h"
+#include "vault_catalog.h"
+#include "vault_files.h"
+#include "vault_consts.h"
+
+// benchmark parameters
+#define BENCH_VAULT_NAME "bench.vlt"
+#define BENCH_SRC_DIR "src"
+#define BENCH_FNAME "bench_%d"
+#define NUM_OP_TYPES 4
+#define OP_ADD 0
+#define OP_RM 1
+#define OP_FETCH 2
+#define OP_DEFRAG 3
+
+// benchmark messages
+#define BENCH_USAGE_ERR "Usage: ./vault_bench <work_dir> <vault_size> <num_ops> [options]\n" \
+	"  -s <min>:<max>  file size range (default 1K:64K)\n" \
+	"  -d <dist>       file size distribution: uniform | loguniform (default uniform)\n" \
+	"  -r <ratio>      fraction of operations that remove a file (default 0.3)\n" \
+	"  -f <ratio>      fraction of operations that fetch a file (default 0.2)\n" \
+	"  -D <n>          defragment every n operations (default 0 - never)\n" \
+	"  -p <policy>     allocation policy: "POLICY_LIST" (default "BEST_FIT_POLICY")\n" \
+	"  -i <n>          report fragmentation every n operations (default num_ops/10)\n" \
+	"  -S <seed>       random seed (default 1)\n"
+#define BENCH_DIR_ERR "Error preparing benchmark directory: %s\n"
+#define BENCH_SRC_ERR "Error creating source file: %s\n"
+#define BENCH_HEADER_MSG "%-8s%8s%8s%12s%12s%12s%12s%14s%14s\n"
+#define BENCH_OP_MSG "%-8s%8d%8d%12.3f%12.3f%12.3f%12.3f%14.0f%14.0f\n"
+#define BENCH_FRAG_HEADER_MSG "%-8s%8s%12s%12s\n"
+#define BENCH_FRAG_MSG "%-8d%8d%12.4f%12.2f\n"
+
+// latency and io samples of a single operation type
+typedef struct op_samples_t {
+	double* latency;
+	int numOps;
+	int numFailed;
+	double bytesRead;
+	double bytesWritten;
+} OpSamples;
+
+/*
+ * Get current monotonic time in milliseconds
+ */
+double nowMs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * Get number of bytes read and written by this process so far (from /proc/self/io)
+ * Leaves counters untouched if not available.
+ */
+void getIOBytes(long long* bytesRead, long long* bytesWritten) {
+	FILE* ioFile = fopen("/proc/self/io", "r");
+	if (ioFile == NULL)
+		return;
+	char key[32];
+	long long value;
+	while (fscanf(ioFile, "%31s %lld", key, &value) == 2) {
+		if (streq(key, "rchar:"))
+			*bytesRead = value;
+		else if (streq(key, "wchar:"))
+			*bytesWritten = value;
+	}
+	fclose(ioFile);
+}
+
+/*
+ * Draw a random file size in range according to distribution
+ */
+ssize_t randomSize(ssize_t minSize, ssize_t maxSize, int logUniform) {
+	double r = (double) random() / RAND_MAX;
+	if (logUniform)
+		return (ssize_t) exp(log(minSize) + r * (log(maxSize) - log(minSize)));
+	return minSize + (ssize_t) (r * (maxSize - minSize));
+}
+
+/*
+ * Create a source file of given size with random content
+ * Returns 0 on success, -1 on failure
+ */
+int createSourceFile(char* path, ssize_t size) {
+	char buffer[BUFFER_SIZE];
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf(BENCH_SRC_ERR, strerror(errno));
+		return -1;
+	}
+	while (size > 0) {
+		ssize_t writeSize = (size < BUFFER_SIZE) ? size : BUFFER_SIZE;
+		for (int i=0; i < writeSize; i++)
+			buffer[i] = (char) random();
+		if (write(fd, buffer, writeSize) != writeSize) {
+			printf(BENCH_SRC_ERR, strerror(errno));
+			close(fd);
+			return -1;
+		}
+		size -= writeSize;
+	}
+	close(fd);
+	return 0;
+}
+
+/*
+ * Compare doubles for qsort
+ */
+int cmpDouble(const void* a, const void* b) {
+	double diff = *((double*) a) - *((double*) b);
+	return (diff > 0) - (diff < 0);
+}
+
+/*
+ * Get percentile of sorted samples
+ */
+double percentile(double* sorted, int num, double p) {
+	if (num == 0)
+		return 0;
+	int idx = (int) ceil(p / 100 * num) - 1;
+	return sorted[idx < 0 ? 0 : idx];
+}
+
+/*
+ * Replays a random add/rm/fetch/defrag workload against a vault created in
+ * work_dir. Every operation opens and closes the vault like the vault CLI does.
+ * Reports per-operation latency percentiles, bytes of I/O per operation and
+ * fragmentation ratio over time.
+ */
+int main (int argc, char** argv) {
+	ssize_t minSize = 1024, maxSize = 64*1024;
+	int logUniform = 0, defragEvery = 0, reportEvery = 0;
+	double rmRatio = 0.3, fetchRatio = 0.2;
+	short allocPolicy = ALLOC_BEST_FIT;
+	unsigned int seed = 1;
+
+	// parse options
+	int opt;
+	char* sep;
+	while ((opt = getopt(argc, argv, "s:d:r:f:D:p:i:S:")) != -1) {
+		switch (opt) {
+		case 's':
+			sep = strchr(optarg, ':');
+			if (sep == NULL) { printf(BENCH_USAGE_ERR); return -1; }
+			*sep = '\0';
+			minSize = parseSize(optarg);
+			maxSize = parseSize(sep + 1);
+			break;
+		case 'd': logUniform = streq(optarg, "loguniform"); break;
+		case 'r': rmRatio = atof(optarg); break;
+		case 'f': fetchRatio = atof(optarg); break;
+		case 'D': defragEvery = atoi(optarg); break;
+		case 'p': allocPolicy = parseAllocPolicy(optarg); break;
+		case 'i': reportEvery = atoi(optarg); break;
+		case 'S': seed = atoi(optarg); break;
+		default: printf(BENCH_USAGE_ERR); return -1;
+		}
+	}
+	if (argc - optind < 3 || minSize <= 0 || maxSize < minSize || allocPolicy == -1) {
+		printf(BENCH_USAGE_ERR);
+		return -1;
+	}
+	char* workDir = argv[optind];
+	ssize_t vaultSize = parseSize(argv[optind+1]);
+	int numOps = atoi(argv[optind+2]);
+	if (vaultSize <= 0 || numOps <= 0) {
+		printf(BENCH_USAGE_ERR);
+		return -1;
+	}
+	if (reportEvery <= 0)
+		reportEvery = (numOps >= 10) ? numOps / 10 : 1;
+	srandom(seed);
+
+	// prepare work dir - fetched files are created in it
+	if ((mkdir(workDir, 0777) == -1 && errno != EEXIST) || chdir(workDir) == -1 ||
+		(mkdir(BENCH_SRC_DIR, 0777) == -1 && errno != EEXIST)) {
+		printf(BENCH_DIR_ERR, strerror(errno));
+		return -1;
+	}
+
+	// vault functions report to stdout - keep it for the report and silence them
+	FILE* report = fdopen(dup(STDOUT_FILENO), "w");
+	int devNull = open("/dev/null", O_WRONLY);
+	if (report == NULL || devNull < 0) {
+		printf(BENCH_DIR_ERR, strerror(errno));
+		return -1;
+	}
+	fflush(stdout);
+	dup2(devNull, STDOUT_FILENO);
+	close(devNull);
+
+	if (initVault(BENCH_VAULT_NAME, vaultSize, allocPolicy) == -1) {
+		fprintf(report, VAULT_CREATION_ERR, "see vault output");
+		return -1;
+	}
+
+	// samples per operation type
+	char* opNames[NUM_OP_TYPES] = {ADD_CMND, RM_CMND, FETCH_CMND, DEFRAG_CMND};
+	OpSamples samples[NUM_OP_TYPES];
+	for (int i=0; i < NUM_OP_TYPES; i++) {
+		samples[i].latency = (double*) malloc(numOps * sizeof(double));
+		samples[i].numOps = samples[i].numFailed = 0;
+		samples[i].bytesRead = samples[i].bytesWritten = 0;
+		if (samples[i].latency == NULL) {
+			fprintf(report, ALLOC_ERR);
+			return -1;
+		}
+	}
+
+	// bytes /proc/self/io reports for reading itself - subtracted from samples
+	long long readBefore = 0, writtenBefore = 0, readAfter = 0, writtenAfter = 0;
+	getIOBytes(&readBefore, &writtenBefore);
+	getIOBytes(&readAfter, &writtenAfter);
+	long long ioOverhead = readAfter - readBefore;
+
+	// files currently in vault
+	int liveFiles[MAX_VAULT_FILES], numLive = 0, nextFileId = 0;
+	char path[MAX_VAULT_FNAME + 1], fileName[MAX_VAULT_FNAME + 1], msg[1024];
+
+	fprintf(report, BENCH_FRAG_HEADER_MSG, "op", "files", "frag", "frags/file");
+	for (int op=1; op <= numOps; op++) {
+		// choose operation
+		int opType;
+		double r = (double) random() / RAND_MAX;
+		if (defragEvery > 0 && op % defragEvery == 0)
+			opType = OP_DEFRAG;
+		else if (numLive == 0)
+			opType = OP_ADD;
+		else if (r < rmRatio || numLive == MAX_VAULT_FILES)
+			opType = OP_RM;
+		else if (r < rmRatio + fetchRatio)
+			opType = OP_FETCH;
+		else
+			opType = OP_ADD;
+
+		// prepare operation (not timed)
+		int liveIdx = (numLive > 0) ? random() % numLive : 0;
+		if (opType == OP_ADD) {
+			sprintf(fileName, BENCH_FNAME, nextFileId);
+			sprintf(path, BENCH_SRC_DIR"/"BENCH_FNAME, nextFileId);
+			if (createSourceFile(path, randomSize(minSize, maxSize, logUniform)) == -1)
+				return -1;
+		}
+		else if (opType != OP_DEFRAG)
+			sprintf(fileName, BENCH_FNAME, liveFiles[liveIdx]);
+
+		// run operation like the vault CLI - open, run, close
+		getIOBytes(&readBefore, &writtenBefore);
+		double startTime = nowMs();
+		int res = -1, vaultFd, updateCatalog = 0;
+		Catalog catalog = openVault(BENCH_VAULT_NAME, &vaultFd);
+		if (catalog != NULL) {
+			if (opType == OP_ADD)
+				res = addVaultFile(path, vaultFd, catalog, &updateCatalog, msg);
+			else if (opType == OP_RM)
+				res = rmVaultFile(fileName, vaultFd, catalog, &updateCatalog, msg);
+			else if (opType == OP_FETCH)
+				res = fetchVaultFile(fileName, vaultFd, catalog, 0, msg);
+			else
+				res = defragVault(BENCH_VAULT_NAME, vaultFd, catalog, &updateCatalog, msg);
+
+			// sample fragmentation before catalog is released
+			if (op % reportEvery == 0) {
+				ssize_t totalSize;
+				double fragRatio = getFragRatio(catalog, &totalSize);
+				fprintf(report, BENCH_FRAG_MSG, op, catalog->numFiles, fragRatio,
+						(catalog->numFiles > 0) ? ((double) catalog->numBlocks) / catalog->numFiles : 0);
+			}
+			if (closeVault(vaultFd, catalog, updateCatalog) == -1)
+				res = -1;
+		}
+		double latency = nowMs() - startTime;
+		getIOBytes(&readAfter, &writtenAfter);
+
+		// record sample
+		OpSamples* opSamples = &samples[opType];
+		opSamples->latency[opSamples->numOps++] = latency;
+		opSamples->bytesRead += readAfter - readBefore - ioOverhead;
+		opSamples->bytesWritten += writtenAfter - writtenBefore;
+		if (res == -1)
+			opSamples->numFailed++;
+
+		// update live files and clean up
+		if (opType == OP_ADD) {
+			unlink(path);
+			if (res != -1)
+				liveFiles[numLive++] = nextFileId;
+			nextFileId++;
+		}
+		else if (opType == OP_RM && res != -1)
+			liveFiles[liveIdx] = liveFiles[--numLive];
+		else if (opType == OP_FETCH)
+			unlink(fileName);
+	}
+
+	// report latency percentiles and io per operation type
+	fprintf(report, "\n"BENCH_HEADER_MSG, "cmd", "ops", "failed", "p50 ms", "p90 ms", "p99 ms",
+			"max ms", "read B/op", "write B/op");
+	for (int i=0; i < NUM_OP_TYPES; i++) {
+		OpSamples* opSamples = &samples[i];
+		if (opSamples->numOps == 0)
+			continue;
+		qsort(opSamples->latency, opSamples->numOps, sizeof(double), cmpDouble);
+		fprintf(report, BENCH_OP_MSG, opNames[i], opSamples->numOps, opSamples->numFailed,
+				percentile(opSamples->latency, opSamples->numOps, 50),
+				percentile(opSamples->latency, opSamples->numOps, 90),
+				percentile(opSamples->latency, opSamples->numOps, 99),
+				opSamples->latency[opSamples->numOps-1],
+				opSamples->bytesRead / opSamples->numOps,
+				opSamples->bytesWritten / opSamples->numOps);
+		free(opSamples->latency);
+	}
+
+	fclose(report);
+	return 0;
+}
@@ -1,9 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <malloc.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/time.h>
@@ -12,9 +14,26 @@
 #include "vault_catalog.h"
 #include "vault_consts.h"
 #include "vault_aux.h"
+#include "vault_stats.h"
+
+// size of catalog part of vault file in use - up to end of used name heap
+#define CATALOG_USED_SIZE(catalog) (offsetof(struct catalog_t, nameHeap) + (catalog)->nameHeapSize)
+
+/* Hash file name for fast fat lookup (FNV-1a)
+ *
+ * @param fileName - name of file
+ *
+ * @return hash of file name
+ */
+unsigned int hashFileName(char* fileName) {
+	unsigned int hash = 2166136261u;
+	for (; *fileName; fileName++)
+		hash = (hash ^ (unsigned char) *fileName) * 16777619u;
+	return hash;
+}
 
 /* Initialize vault - creates a new vault of specified size */
-int initVault(char* vaultFileName, ssize_t vaultSize) {
+int initVault(char* vaultFileName, ssize_t vaultSize, short allocPolicy) {
 	int res = 0;
 	// create catalog
 	Catalog catalog = NULL;
@@ -34,14 +53,20 @@ int initVault(char* vaultFileName, ssize_t vaultSize) {
 	catalog->vaultSize = vaultSize;
 	catalog->numFiles = 0;
 	catalog->numBlocks = 0;
+	catalog->nameHeapSize = 0;
+
+	// initialize allocator
+	catalog->allocPolicy = allocPolicy;
+	catalog->nextFitOffset = sizeof(*catalog);
+	catalog->allocStats.numAllocs = 0;
+	catalog->allocStats.numFragments = 0;
+	catalog->allocStats.maxFragments = 0;
 
 	// nullify all fat entries and blocks
-	for (int i=0; i < MAX_VAULT_FILES; i++) {
-		for (int j=0; j < VAULT_BLOCK_NUM; j++) {
-			catalog->fat[i].blockId[j] = -1;
-			catalog->blocks[i*VAULT_BLOCK_NUM + j].fatEntryId = -1;
-		}
-	}
+	for (int i=0; i < MAX_VAULT_FILES; i++)
+		catalog->fat[i].numBlocks = 0;
+	for (int i=0; i < MAX_VAULT_BLOCKS; i++)
+		catalog->blocks[i].fatEntryId = -1;
 
 	// time
 	struct timeval creationTime;
@@ -58,14 +83,13 @@ int initVault(char* vaultFileName, ssize_t vaultSize) {
 	}
 
 	// write catalog to file
-	else if (write(vaultFd,catalog, sizeof(*catalog)) != sizeof(*catalog)) {
+	else if (statsWrite(vaultFd,catalog, CATALOG_USED_SIZE(catalog)) != CATALOG_USED_SIZE(catalog)) {
 		printf(CATALOG_WRITE_ERR, strerror(errno));
 		res = -1;
 	}
 
-	// strech file
-	else if (lseek(vaultFd, vaultSize-1, SEEK_SET) == -1 ||
-		write(vaultFd, "", 1) < 0) {
+	// strech file - sparse, space is allocated when files are added
+	else if (ftruncate(vaultFd, vaultSize) == -1) {
 		printf(VAULT_STRECH_ERR, strerror(errno));
 		res = -1;
 	}
@@ -77,6 +101,18 @@ int initVault(char* vaultFileName, ssize_t vaultSize) {
 	return res;
 }
 
+/* Parse allocation policy name (bestfit / nextfit / segregated) */
+short parseAllocPolicy(char* policyStr) {
+	strToLower(policyStr);
+	if (streq(policyStr, BEST_FIT_POLICY))
+		return ALLOC_BEST_FIT;
+	if (streq(policyStr, NEXT_FIT_POLICY))
+		return ALLOC_NEXT_FIT;
+	if (streq(policyStr, SEGREGATED_POLICY))
+		return ALLOC_SEGREGATED;
+	return -1;
+}
+
 /* Opens vault for for read-write and loads meta-data */
 Catalog openVault(char* vaultFileName, int *vaultFd) {
 	// open vault file
@@ -96,9 +132,17 @@ Catalog openVault(char* vaultFileName, int *vaultFd) {
 		return NULL;
 	}
 
-	// read catalog
-    ssize_t readSize = read(*vaultFd, catalog, sizeof(*catalog));
-    if (readSize != sizeof(*catalog)) {
+	// read catalog - fixed size part and then used part of name heap
+	double startTime = statsStart();
+    ssize_t readSize = statsRead(*vaultFd, catalog, offsetof(struct catalog_t, nameHeap));
+    if (readSize == offsetof(struct catalog_t, nameHeap)) {
+    	if (catalog->nameHeapSize < 0 || catalog->nameHeapSize > sizeof(catalog->nameHeap))
+    		readSize = 0;
+    	else if (statsRead(*vaultFd, catalog->nameHeap, catalog->nameHeapSize) != catalog->nameHeapSize)
+    		readSize = -1;
+    }
+    statsEnd(PHASE_CATALOG_LOAD, startTime);
+    if (readSize != offsetof(struct catalog_t, nameHeap)) {
     	if (readSize == -1)
     		printf(CATALOG_READ_ERR, strerror(errno));
     	else
@@ -120,14 +164,16 @@ int closeVault(int vaultFd, Catalog catalog, int updateCatalog) {
 		}
 		else {
 			// write catalog to vault
-			if (lseek(vaultFd, 0, SEEK_SET) == -1) {
+			double startTime = statsStart();
+			if (statsLseek(vaultFd, 0, SEEK_SET) == -1) {
 				printf(VAULT_SEEK_ERR, strerror(errno));
 				res = -1;
 			}
-			else if (write(vaultFd,catalog, sizeof(*catalog)) != sizeof(*catalog)) {
+			else if (statsWrite(vaultFd,catalog, CATALOG_USED_SIZE(catalog)) != CATALOG_USED_SIZE(catalog)) {
 				printf(CATALOG_WRITE_ERR, strerror(errno));
 				res = -1;
 			}
+			statsEnd(PHASE_CATALOG_STORE, startTime);
 		}
 	}
 	if (catalog != NULL) free(catalog);
@@ -140,40 +186,78 @@ int listVault(Catalog catalog) {
 	// get length of longest file name
 	int fnameLen = 0;
 	for (int i=0; i<catalog->numFiles; i++)
-		if (strlen(catalog->fat[i].fileName) > fnameLen)
-			fnameLen = strlen(catalog->fat[i].fileName);
+		if (strlen(getFileName(i, catalog)) > fnameLen)
+			fnameLen = strlen(getFileName(i, catalog));
 
 	// format and print
 	char sizeStr[10];
 	for (int i=0; i<catalog->numFiles; i++) {
 		formatSize(sizeStr, catalog->fat[i].fileSize);
-		printf("%-*s%-8s%.4o%32s",fnameLen+4, catalog->fat[i].fileName, sizeStr,
-						catalog->fat[i].filePerm & 0777,
-						ctime(&(catalog->fat[i].insertionTime)));
+		printf("%-*s%-8s%.4o%32s",fnameLen+4, getFileName(i, catalog), sizeStr,
+						catalog->filePerm[i] & 0777,
+						ctime(&(catalog->insertionTime[i])));
 	}
 
 	return 0;
 }
 
+/* Calculate vault fragmentation ratio */
+double getFragRatio(Catalog catalog, ssize_t* totalSize) {
+	*totalSize = 0;
+	if (catalog->numBlocks == 0)
+		return 0;
+
+	// calculate total size of all files (including delimiters)
+	for (int blockId=0; blockId < catalog->numBlocks; blockId++)
+		*totalSize += catalog->blocks[blockId].blockSize;
+
+	// calculate fragmentation ratio
+	return 1 - ((double) *totalSize) / (catalog->blocks[catalog->numBlocks-1].blockOffset +
+			catalog->blocks[catalog->numBlocks-1].blockSize - catalog->blocks[0].blockOffset);
+}
+
 /* Outputs vault status */
-int getVaultStatus(Catalog catalog) {
+int getVaultStatus(Catalog catalog, int vaultFd) {
+	// get space allocated on disk
+	struct stat vaultStats;
+	if (fstat(vaultFd, &vaultStats) == -1) {
+		printf(VAULT_STAT_ERR, strerror(errno));
+		return -1;
+	}
+
 	// calculate status
 	ssize_t totalSize = 0;
-	double fragRatio = 0;
-	if (catalog->numBlocks > 0) {
-		// calculate total size of all files (including delimiters)
-		for (int blockId=0; blockId < catalog->numBlocks; blockId++)
-			totalSize += catalog->blocks[blockId].blockSize;
-
-		// calculate fragmentation ratio
-		fragRatio = 1 - ((double) totalSize) / (catalog->blocks[catalog->numBlocks-1].blockOffset +
-				catalog->blocks[catalog->numBlocks-1].blockSize - catalog->blocks[0].blockOffset);
+	double fragRatio = getFragRatio(catalog, &totalSize);
+
+	// calculate free space - gaps between blocks (and after last block)
+	long long freeSize = 0, largestGap = 0;
+	int numGaps = 0;
+	off_t prevEndOffset = sizeof(*catalog);
+	for (int blockId=0; blockId <= catalog->numBlocks; blockId++) {
+		off_t nextOffset = (blockId < catalog->numBlocks) ?
+				catalog->blocks[blockId].blockOffset : catalog->vaultSize;
+		if (nextOffset > prevEndOffset) {
+			freeSize += nextOffset - prevEndOffset;
+			if (nextOffset - prevEndOffset > largestGap)
+				largestGap = nextOffset - prevEndOffset;
+			numGaps++;
+		}
+		if (blockId < catalog->numBlocks)
+			prevEndOffset = nextOffset + catalog->blocks[blockId].blockSize;
 	}
 
 	// output status
+	char* policyNames[] = {BEST_FIT_POLICY, NEXT_FIT_POLICY, SEGREGATED_POLICY};
+	printf(VAULT_SIZE_MSG, (long long) catalog->vaultSize, (long long) vaultStats.st_blocks * 512);
 	printf(NUM_FILES_MSG, catalog->numFiles);
 	printf(TOTAL_SIZE_MSG, totalSize);
 	printf(FRAG_RATIO_MSG, fragRatio);
+	printf(ALLOC_POLICY_MSG, policyNames[catalog->allocPolicy]);
+	printf(FREE_SPACE_MSG, freeSize, numGaps, largestGap);
+	printf(ALLOC_COUNT_MSG, catalog->allocStats.numAllocs, catalog->allocStats.numFragments,
+			catalog->allocStats.maxFragments);
+	printf(AVG_FRAGS_MSG, (catalog->numFiles > 0) ?
+			((double) catalog->numBlocks) / catalog->numFiles : 0);
 	//printFAT(catalog);
 	//printBlocks(catalog);
 
@@ -182,12 +266,91 @@ int getVaultStatus(Catalog catalog) {
 
 /* Get the index of the fat entry of a file by name */
 int getFATEntryId(char* fileName, Catalog catalog) {
+	// compare hashes first - only matching entries touch the name heap
+	unsigned int nameHash = hashFileName(fileName);
 	for (int i=0; i<catalog->numFiles; i++)
-		if (streq(fileName,catalog->fat[i].fileName))
+		if (catalog->fat[i].nameHash == nameHash && streq(fileName, getFileName(i, catalog)))
 			return i;
 	return -1;
 }
 
+/* Get the name of a file in fat */
+char* getFileName(short fatEntryId, Catalog catalog) {
+	return catalog->nameHeap + catalog->fat[fatEntryId].nameOffset;
+}
+
+/* Insert a new fat entry for a file name, keeping fat sorted by file name */
+short insertFATEntry(char* fileName, Catalog catalog) {
+	// binary search for location to fit file alphabetically
+	short low = 0, high = catalog->numFiles;
+	while (low < high) {
+		short mid = (low + high) / 2;
+		if (strcmp(fileName, getFileName(mid, catalog)) > 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	short fatEntryId = low;
+
+	// shift entries right to make room
+	for (int i=catalog->numFiles; i > fatEntryId; i--) {
+		catalog->fat[i] = catalog->fat[i-1];
+		catalog->filePerm[i] = catalog->filePerm[i-1];
+		catalog->insertionTime[i] = catalog->insertionTime[i-1];
+	}
+	// fix blocks->fat pointers
+	for (int i=0; i<catalog->numBlocks; i++)
+		if (catalog->blocks[i].fatEntryId >= fatEntryId)
+			catalog->blocks[i].fatEntryId++;
+	catalog->numFiles++;
+
+	// append name to name heap
+	FATEntry *fatEntry = &(catalog->fat[fatEntryId]);
+	fatEntry->nameHash = hashFileName(fileName);
+	fatEntry->nameOffset = catalog->nameHeapSize;
+	fatEntry->numBlocks = 0;
+	strcpy(catalog->nameHeap + catalog->nameHeapSize, fileName);
+	catalog->nameHeapSize += strlen(fileName) + 1;
+
+	return fatEntryId;
+}
+
+/* Remove a fat entry (blocks of file must already be removed) */
+void removeFATEntry(short fatEntryId, Catalog catalog) {
+	// remove name from name heap and fix offsets of succeeding names
+	int nameOffset = catalog->fat[fatEntryId].nameOffset;
+	int nameLen = strlen(getFileName(fatEntryId, catalog)) + 1;
+	memmove(catalog->nameHeap + nameOffset, catalog->nameHeap + nameOffset + nameLen,
+			catalog->nameHeapSize - nameOffset - nameLen);
+	catalog->nameHeapSize -= nameLen;
+	for (int i=0; i<catalog->numFiles; i++)
+		if (catalog->fat[i].nameOffset > nameOffset)
+			catalog->fat[i].nameOffset -= nameLen;
+
+	// shift entries left
+	for (int i=fatEntryId; i< catalog->numFiles-1; i++) {
+		catalog->fat[i] = catalog->fat[i+1];
+		catalog->filePerm[i] = catalog->filePerm[i+1];
+		catalog->insertionTime[i] = catalog->insertionTime[i+1];
+	}
+	// fix blocks->fat pointers
+	for (int i=0; i<catalog->numBlocks; i++)
+		if (catalog->blocks[i].fatEntryId > fatEntryId)
+			catalog->blocks[i].fatEntryId--;
+	// nullify last entry
+	catalog->fat[catalog->numFiles-1].numBlocks = 0;
+	catalog->numFiles --;
+}
+
+/* Get the block indices of all fragments of a file, ordered by fragment number */
+short getFileBlocks(short fatEntryId, Catalog catalog, short* blockIds) {
+	// blocks are sorted by offset, so place each by its fragment number
+	for (int i=0; i<catalog->numBlocks; i++)
+		if (catalog->blocks[i].fatEntryId == fatEntryId)
+			blockIds[catalog->blocks[i].blockNum] = i;
+	return catalog->fat[fatEntryId].numBlocks;
+}
+
 /*** DEBUG PRINT METHODS ***/
 
 /* Print attributes of a specific vault block */
@@ -197,9 +360,10 @@ void printVaultBlock(VaultBlock vaultBlock) {
 }
 
 /* Print attributes of a specific fat entry */
-void printFATEntry(FATEntry fatEntry) {
-	printf("name: %s\tsize: %d\tperm: %.4o\n", fatEntry.fileName,
-			(int) fatEntry.fileSize, fatEntry.filePerm & 0777);
+void printFATEntry(short fatEntryId, Catalog catalog) {
+	printf("name: %s\tsize: %d\tperm: %.4o\tblocks: %d\n", getFileName(fatEntryId, catalog),
+			(int) catalog->fat[fatEntryId].fileSize, catalog->filePerm[fatEntryId] & 0777,
+			catalog->fat[fatEntryId].numBlocks);
 }
 
 /* Print list of all vault blocks using printVaultBlock */
@@ -214,5 +378,5 @@ void printBlocks(Catalog catalog) {
 void printFAT(Catalog catalog) {
 	printf("num files: %d\n",catalog->numFiles);
 	for (int i=0; i<catalog->numFiles; i++)
-		printFATEntry(catalog->fat[i]);
+		printFATEntry(i, catalog);
 }
@@ -6,32 +6,52 @@
 
 typedef struct fat_entry_t FATEntry;
 typedef struct vault_block_t VaultBlock;
+typedef struct alloc_stats_t AllocStats;
 typedef struct catalog_t* Catalog;
 
+// hot file meta-data - scanned on lookup and shifted on add / remove
 struct fat_entry_t {
-	char fileName[MAX_VAULT_FNAME + 1];
+	unsigned int nameHash;
+	int nameOffset;
 	ssize_t fileSize;
-	mode_t filePerm;
-	time_t insertionTime;
-	short blockId[VAULT_BLOCK_NUM];
+	short numBlocks;
 };
 
 struct vault_block_t {
 	short fatEntryId;
 	short blockNum;
+	unsigned int blockCrc;
 	ssize_t blockSize;
 	off_t blockOffset;
 };
 
+struct alloc_stats_t {
+	long numAllocs;
+	long numFragments;
+	short maxFragments;
+};
+
 
+/* Catalog layout (in memory and in vault file) - struct of arrays:
+ * header, hot fat entries, cold file attributes, blocks and a heap of
+ * NULL terminated file names (indexed by fat entry name offset).
+ * The name heap is last so only its used part is read and written.
+ */
 struct catalog_t {
 	ssize_t vaultSize;
 	time_t creationTime;
 	time_t modificationTime;
 	short numFiles;
 	short numBlocks;
+	short allocPolicy;
+	off_t nextFitOffset;
+	AllocStats allocStats;
+	int nameHeapSize;
 	FATEntry fat[MAX_VAULT_FILES];
-	VaultBlock blocks[MAX_VAULT_FILES*VAULT_BLOCK_NUM];
+	mode_t filePerm[MAX_VAULT_FILES];
+	time_t insertionTime[MAX_VAULT_FILES];
+	VaultBlock blocks[MAX_VAULT_BLOCKS];
+	char nameHeap[MAX_VAULT_FILES * (MAX_VAULT_FNAME + 1)];
 };
 
 /* Initialize vault - creates a new vault of specified size.
@@ -39,10 +59,20 @@ struct catalog_t {
  * @param vaultFileName - path to create vault file
  * @param vaultSize - request vault file size in bytes
  * 		fails if size is too small to contain vault meta-data.
+ * @param allocPolicy - gap allocation policy used when adding files
+ * 		(ALLOC_BEST_FIT / ALLOC_NEXT_FIT / ALLOC_SEGREGATED)
  *
  * @return 0 for success, -1 for failure
  */
-int initVault(char* vaultFileName, ssize_t vaultSize);
+int initVault(char* vaultFileName, ssize_t vaultSize, short allocPolicy);
+
+/* Parse allocation policy name (bestfit / nextfit / segregated)
+ *
+ * @param policyStr - policy name
+ *
+ * @return policy id on success, -1 if name is not a known policy
+ */
+short parseAllocPolicy(char* policyStr);
 
 /* Opens vault for for read-write and loads meta-data.
  *
@@ -76,18 +106,33 @@ int closeVault(int vaultFd, Catalog catalog, int updateCatalog);
  */
 int listVault(Catalog catalog);
 
+/* Calculate vault fragmentation ratio - 1 - (total size) / (consumed size)
+ * (see getVaultStatus)
+ *
+ * @param catalog - vault meta-data
+ * @param totalSize - return parameter - total size of all files in vault
+ * 					  (including delimiters)
+ *
+ * @return fragmentation ratio, 0 if vault is empty
+ */
+double getFragRatio(Catalog catalog, ssize_t* totalSize);
+
 /* Outputs vault status:
+ *   - vault size - logical and allocated on disk (vault file is sparse)
  *   - number of files in vault
  *   - total size of all files in vault (including delimiters)
  *   - fragmentation ratio - (total size) / (consumed size) where
  *     "consumed size" is the distance between the start of the
  *     first file to the end of the last file in the vault.
+ *   - allocator statistics - policy, free space and gaps,
+ *     number of allocations and fragments per file
  *
  * @param catalog - vault meta-data
+ * @param vaultFd - file descriptor of vault file
  *
  * @return 0 for success, -1 for failure
  */
-int getVaultStatus(Catalog catalog);
+int getVaultStatus(Catalog catalog, int vaultFd);
 
 /* Get the index of the fat entry of a file by name
  *
@@ -99,6 +144,46 @@ int getVaultStatus(Catalog catalog);
  */
 int getFATEntryId(char* fileName, Catalog catalog);
 
+/* Get the name of a file in fat
+ *
+ * @param fatEntryId - index of file in fat
+ * @param catalog - vault meta-data
+ *
+ * @return pointer to file name in catalog name heap
+ */
+char* getFileName(short fatEntryId, Catalog catalog);
+
+/* Insert a new fat entry for a file name, keeping fat sorted by file name.
+ * Shifts succeeding entries (and fixes their blocks) and adds the name to
+ * the name heap. Other attributes of the entry are left for the caller.
+ *
+ * @param fileName - name of file (must not be in fat already)
+ * @param catalog - vault meta-data
+ *
+ * @return index of new fat entry
+ */
+short insertFATEntry(char* fileName, Catalog catalog);
+
+/* Remove a fat entry (blocks of file must already be removed).
+ * Shifts succeeding entries (and fixes their blocks) and removes the name
+ * from the name heap.
+ *
+ * @param fatEntryId - index of file in fat
+ * @param catalog - vault meta-data
+ */
+void removeFATEntry(short fatEntryId, Catalog catalog);
+
+/* Get the block indices of all fragments of a file, ordered by fragment number
+ *
+ * @param fatEntryId - index of file in fat
+ * @param catalog - vault meta-data
+ * @param blockIds - return parameter - array of at least MAX_VAULT_BLOCKS entries
+ * 					 set to the block index of each fragment
+ *
+ * @return number of fragments of file
+ */
+short getFileBlocks(short fatEntryId, Catalog catalog, short* blockIds);
+
 
 /*** DEBUG PRINT METHODS ***/
 
@@ -115,10 +200,12 @@ void printVaultBlock(VaultBlock vaultBlock);
  * 	 - file name
  * 	 - file size
  * 	 - file permissions
+ * 	 - number of fragments
  *
- * @param fatEntry - the fat entry at interest
+ * @param fatEntryId - index of the fat entry at interest
+ * @param catalog - vault meta-data
  */
-void printFATEntry(FATEntry fatEntry);
+void printFATEntry(short fatEntryId, Catalog catalog);
 
 /* Print list of all vault blocks using printVaultBlock.
  * Print first and last allowed file offsets (just after catalog and end of vault file)
@@ -5,12 +5,23 @@
 
 // vault parameters
 #define MAX_VAULT_FILES 100
-#define VAULT_BLOCK_NUM 3
+#define MAX_VAULT_BLOCKS 512
 #define MAX_VAULT_FNAME 256
 #define DELIM_START "<<<<<<<<"
 #define DELIM_END   ">>>>>>>>"
 #define DELIM_WIPE  "00000000"
 #define BUFFER_SIZE 4096
+#define VERIFY_BUFFER_SIZE (1024*1024)
+#define VERIFY_MAX_THREADS 16
+
+// allocation policies
+#define ALLOC_BEST_FIT 0
+#define ALLOC_NEXT_FIT 1
+#define ALLOC_SEGREGATED 2
+#define BEST_FIT_POLICY "bestfit"
+#define NEXT_FIT_POLICY "nextfit"
+#define SEGREGATED_POLICY "segregated"
+#define POLICY_LIST BEST_FIT_POLICY" | "NEXT_FIT_POLICY" | "SEGREGATED_POLICY
 
 // vault commands
 #define INIT_CMND "init"
@@ -20,7 +31,14 @@
 #define FETCH_CMND "fetch"
 #define DEFRAG_CMND "defrag"
 #define STATUS_CMND "status"
-#define CMNDS_LIST INIT_CMND" | "LIST_CMND" | "ADD_CMND" | "RM_CMND" | "FETCH_CMND" | "DEFRAG_CMND" | "STATUS_CMND
+#define GROW_CMND "grow"
+#define SHRINK_CMND "shrink"
+#define VERIFY_CMND "verify"
+#define CMNDS_LIST INIT_CMND" | "LIST_CMND" | "ADD_CMND" | "RM_CMND" | "FETCH_CMND" | "DEFRAG_CMND" | "STATUS_CMND" | "GROW_CMND" | "SHRINK_CMND" | "VERIFY_CMND
+
+// command flags
+#define VERIFY_FLAG "--verify"
+#define STATS_FLAG "--stats"
 
 // general errors
 #define ALLOC_ERR "Allocation error\n"
@@ -29,10 +47,12 @@
 
 // vault usage errors
 #define ARG_NUM_ERR "Invalid number of arguments\n"
-#define USAGE_ERR "Usage: ./vault <vault_file> <command> (<argument>)\n"
+#define USAGE_ERR "Usage: ./vault <vault_file> <command> (<argument>) ("STATS_FLAG")\n"
 #define INVALID_CMND_ERR "Invalid command. Command must be one of:\n"CMNDS_LIST"\n"
 #define INIT_SIZE_ERR "Vault file size must be supplied as an integer followed by a unit letter B,K,M,G\n"
+#define INIT_POLICY_ERR "Allocation policy must be one of:\n"POLICY_LIST"\n"
 #define NO_FILENAME_ERR "No filename supplied\n"
+#define RESIZE_SIZE_ERR "Resize amount must be supplied as an integer followed by a unit letter B,K,M,G\n"
 
 // vault io errors
 #define VAULT_SIZE_ERR "Vault too small\n"
@@ -41,6 +61,10 @@
 #define VAULT_CREATION_ERR "Error creating vault file: %s\n"
 #define CATALOG_WRITE_ERR "Error writing catalog to vault file: %s\nVault file might be corrupt\n"
 #define VAULT_STRECH_ERR "Error stretching vault file to required size: %s\n"
+#define VAULT_TRUNCATE_ERR "Error truncating vault file to required size: %s\n"
+#define VAULT_ALLOC_ERR "Error allocating vault space for file: %s\n"
+#define VAULT_PUNCH_ERR "Error releasing vault space of removed block: %s\n"
+#define VAULT_STAT_ERR "Error getting vault file state: %s\n"
 #define FILE_OPEN_ERR "Error opening file to add to vault: %s\n"
 #define VAULT_FWRITE_ERR "Error writing file to vault: %s\n"
 #define VAULT_FREAD_ERR "Error reading file from vault: %s\n"
@@ -48,21 +72,27 @@
 
 // vault file manipulation errors
 #define MAX_FILE_ERR "Maximum number of files exceeded\n"
+#define MAX_BLOCKS_ERR "Maximum number of vault blocks exceeded\n"
 #define CANNOT_FIT_ERR "Could not fit file in vault\n"
 #define FILE_STATS_ERR "Could not get file state: %s\n"
 #define SAME_FNAME_ERR "File with same name already in vault\n"
+#define FNAME_LEN_ERR "File name too long\n"
 #define MISSING_FNAME_ERR "File not in vault\n"
 #define SHORT_BLOCK_ERR "Block too small for delimiters\n"
 #define ADD_BLOCK_COPY_ERR "Error copying block from file to vault\n"
 #define WIPE_DELIM_ERR "Failed wiping delimiters: %s\n"
 #define ADD_DELIM_ERR "Failed adding delimiters\n"
-#define DEFRAG_DELIM_ERR "Failed moving delimiters while defragmenting\n"
+#define MOVE_DELIM_ERR "Failed moving delimiters while relocating block\n"
 #define DATA_CORRUPTION_ERR "Failed while manipulating blocks. Catalog will be rolled back but vault data might have been corrupted.\n"
-#define MOVE_BLOCK_COPY_ERR "Error moving block while defragmenting\n"
+#define MOVE_BLOCK_COPY_ERR "Error moving block while relocating\n"
+#define SHRINK_FIT_ERR "Could not relocate blocks at end of vault - try defragmenting first\n"
 #define FETCH_CREATE_ERR "Error creating fetched file: %s\n"
 #define FETCH_BLOCK_ERR "Error copying fetched file block\n"
 #define FETCH_PERMS_ERR "Error setting fetched file permissions: %s\n"
 #define DEL_FETCH_FILE_ERR "Error removing file after failed fetch: %s\n"
+#define FETCH_CRC_ERR "Fetched file checksum mismatch - vault data is corrupt\n"
+#define VERIFY_THREAD_ERR "Error creating verify thread\n"
+#define VERIFY_CORRUPT_ERR "Result: %d of %d files corrupt\n"
 
 
 // messages
@@ -71,9 +101,22 @@
 #define FETCH_SUCCESS_MSG "Result: %s created\n"
 #define RM_SUCCESS_MSG "Result: %s deleted\n"
 #define DEFRAG_SUCCESS_MSG "Result: Defragmentation complete\n"
+#define VERIFY_SUCCESS_MSG "Result: %d files verified\n"
+#define CORRUPT_FILE_MSG "Corrupt file: %s\n"
+#define RESIZE_SUCCESS_MSG "Result: Vault resized to %s\n"
+#define VAULT_SIZE_MSG "Vault size:            %lldB (%lldB allocated on disk)\n"
 #define NUM_FILES_MSG  "Number of files:       %d\n"
 #define TOTAL_SIZE_MSG "Total size:            %dB\n"
 #define FRAG_RATIO_MSG "Fragmentation ratio:   %.2f\n"
+#define ALLOC_POLICY_MSG "Allocation policy:     %s\n"
+#define FREE_SPACE_MSG "Free space:            %lldB in %d gaps (largest %lldB)\n"
+#define ALLOC_COUNT_MSG "Allocations:           %ld files, %ld fragments (max %d per file)\n"
+#define AVG_FRAGS_MSG "Fragments per file:    %.2f\n"
 
+// statistics messages
+#define STATS_HEADER_MSG "%-20s%10s%12s\n"
+#define STATS_PHASE_MSG "%-20s%10ld%12.3f\n"
+#define STATS_BYTES_MSG "%-20s%10lld\n"
+#define STATS_SYSCALL_MSG "syscalls %-11s%10ld\n"
 
 #endif /* VAULT_CONSTS_H_ */
@@ -0,0 +1,68 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+#include "vault_crc.h"
+
+#define CRC32C_POLY 0x82F63B78 // reversed Castagnoli polynomial
+
+static uint32_t crcTable[256];
+static pthread_once_t crcTableOnce = PTHREAD_ONCE_INIT;
+
+/* Build lookup table - runs once even when verify threads race to first use */
+static void buildCrcTable() {
+	for (uint32_t i=0; i < 256; i++) {
+		uint32_t entry = i;
+		for (int bit=0; bit < 8; bit++)
+			entry = (entry & 1) ? (entry >> 1) ^ CRC32C_POLY : entry >> 1;
+		crcTable[i] = entry;
+	}
+}
+
+/* Update checksum using a lookup table (one byte at a time) */
+static unsigned int crc32cTable(unsigned int crc, const char* data, size_t length) {
+	pthread_once(&crcTableOnce, buildCrcTable);
+	for (size_t i=0; i < length; i++)
+		crc = crcTable[(crc ^ (unsigned char) data[i]) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* Update checksum using the SSE4.2 crc32 instruction (8 bytes at a time) */
+__attribute__((target("sse4.2")))
+static unsigned int crc32cHardware(unsigned int crc, const char* data, size_t length) {
+#if defined(__x86_64__)
+	uint64_t crc64 = crc;
+	for (; length >= 8; data += 8, length -= 8) {
+		uint64_t word;
+		memcpy(&word, data, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = (unsigned int) crc64;
+#endif
+	for (; length >= 4; data += 4, length -= 4) {
+		uint32_t word;
+		memcpy(&word, data, 4);
+		crc = _mm_crc32_u32(crc, word);
+	}
+	for (; length > 0; data++, length--)
+		crc = _mm_crc32_u8(crc, (unsigned char) *data);
+	return crc;
+}
+#endif
+
+/* Update CRC32C (Castagnoli) checksum with a buffer of data */
+unsigned int crc32c(unsigned int crc, const char* data, size_t length) {
+	crc = ~crc;
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("sse4.2"))
+		crc = crc32cHardware(crc, data, length);
+	else
+#endif
+		crc = crc32cTable(crc, data, length);
+	return ~crc;
+}
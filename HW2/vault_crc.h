@@ -0,0 +1,18 @@
+#ifndef VAULT_CRC_H_
+#define VAULT_CRC_H_
+
+#include <stddef.h>
+
+/* Update CRC32C (Castagnoli) checksum with a buffer of data.
+ * Uses the SSE4.2 crc32 instruction when the CPU supports it,
+ * otherwise a lookup table.
+ *
+ * @param crc - checksum of preceding data (0 for start of data)
+ * @param data - pointer to data
+ * @param length - length of data in bytes
+ *
+ * @return updated checksum
+ */
+unsigned int crc32c(unsigned int crc, const char* data, size_t length);
+
+#endif /* VAULT_CRC_H_ */
@@ -7,11 +7,14 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 #include "vault_files.h"
 #include "vault_catalog.h"
 #include "vault_consts.h"
 #include "vault_aux.h"
+#include "vault_crc.h"
+#include "vault_stats.h"
 
 /* Writes data to vault file at given offset
  * Assumes data is a NULL terminated string
@@ -23,11 +26,11 @@
  * @return 0 for success, -1 for failure
  */
 int writeAtOffset(char* data, off_t offset, int vaultFd) {
-	if (lseek(vaultFd, offset, SEEK_SET) == -1) {
+	if (statsLseek(vaultFd, offset, SEEK_SET) == -1) {
 		printf(VAULT_SEEK_ERR, strerror(errno));
 		return -1;
 	}
-	if (write(vaultFd, data, strlen(data)) != strlen(data)) {
+	if (statsWrite(vaultFd, data, strlen(data)) != strlen(data)) {
 		printf(VAULT_FWRITE_ERR, strerror(errno));
 		return -1;
 	}
@@ -49,12 +52,14 @@ int addDelim(VaultBlock vaultBlock, int vaultFd) {
 		return -1;
 	}
 
+	double startTime = statsStart();
 	if ((writeAtOffset(DELIM_START, vaultBlock.blockOffset, vaultFd) == -1) ||
 		(writeAtOffset(DELIM_END, vaultBlock.blockOffset +
 				vaultBlock.blockSize - strlen(DELIM_END), vaultFd) == -1)) {
 		printf(ADD_DELIM_ERR);
 		return -1;
 	}
+	statsEnd(PHASE_DELIM_WRITE, startTime);
 	return 0;
 }
 
@@ -73,12 +78,14 @@ int wipeDelim(VaultBlock vaultBlock, int vaultFd) {
 		return 0;
 
 	// wipe delimiters
+	double startTime = statsStart();
 	if ((writeAtOffset(DELIM_WIPE, vaultBlock.blockOffset, vaultFd) == -1) ||
 		(writeAtOffset(DELIM_WIPE, vaultBlock.blockOffset +
 				vaultBlock.blockSize - strlen(DELIM_WIPE), vaultFd) == -1)) {
 		printf(WIPE_DELIM_ERR, strerror(errno));
 		return -1;
 	}
+	statsEnd(PHASE_DELIM_WRITE, startTime);
 
 	return 0;
 }
@@ -87,42 +94,96 @@ int wipeDelim(VaultBlock vaultBlock, int vaultFd) {
 /* ********** ********** **********     ADD    ********** ********** ********** */
 /* ********** ********** ********** ********** ********** ********** ********** */
 
-/* Find best gap to fit block in according to the following heuristic:
- *   - smallest gap that fits all data if exists
- *   - otherwise largest gap
+/* Get the gap just before a block (from end of previous block or end of catalog)
+ *
+ * @param blockId - index of block following the gap
+ * 					if numBlocks then the gap from last block to end of vault
+ * @param gapOffset - return parameter - offset of start of gap
+ * @param catalog - vault meta-data
+ *
+ * @return gap size
+ */
+ssize_t getGap(short blockId, off_t *gapOffset, Catalog catalog) {
+	if (blockId == 0)
+		*gapOffset = sizeof(*catalog);
+	else
+		*gapOffset = catalog->blocks[blockId-1].blockOffset + catalog->blocks[blockId-1].blockSize;
+
+	if (blockId < catalog->numBlocks)
+		return catalog->blocks[blockId].blockOffset - *gapOffset;
+	return catalog->vaultSize - *gapOffset;
+}
+
+/* Get size class of a gap for the segregated policy - floor(log2(size))
+ *
+ * @param size - gap size
+ *
+ * @return size class
+ */
+int getSizeClass(ssize_t size) {
+	int sizeClass = 0;
+	while (size >>= 1)
+		sizeClass++;
+	return sizeClass;
+}
+
+/* Find gap to fit block in according to the vault allocation policy:
+ *   - best fit: smallest gap that fits all data
+ *   - next fit: first gap that fits all data, scanning from the end
+ *     of the last allocated block and wrapping around
+ *   - segregated: first gap (by offset) of the smallest size class
+ *     (power of 2) that fits all data
+ * If no gap fits all data, under all policies take the largest gap.
  *
  * @param newBlock - return parameter - will hold the parameters of the
- * 					 best fitting gap: gap size, gap offset
+ * 					 chosen gap: gap size, gap offset
  * @param writeSize - size of data to be fitted into block including delimiters
  * @param catalog - vault meta-data
  *
- * @return index of block with best gap before it
+ * @return index of block with chosen gap before it, -1 if vault is full
  */
 short findGap(VaultBlock *newBlock, ssize_t writeSize, Catalog catalog) {
-	short gapBlockId = -1;
-
-	ssize_t gapSize = 0;
-	off_t prevEndOffset = sizeof(*catalog); // first gap - from just after catalog
-
-	for (int blockId=0; blockId <= catalog->numBlocks; blockId++) {
-		// calculate current gap
-		if (blockId < catalog->numBlocks)
-			gapSize = catalog->blocks[blockId].blockOffset - prevEndOffset;
-		else // last gap from last block to end of vault
-			gapSize = catalog->vaultSize - prevEndOffset;
-
-		// check if current gap is better
-		if ((newBlock->blockSize < writeSize && gapSize > newBlock->blockSize) ||
-			(newBlock->blockSize > writeSize && gapSize < newBlock->blockSize && gapSize >= writeSize)) {
-			gapBlockId = blockId;
-			newBlock->blockSize = gapSize;
-			newBlock->blockOffset = prevEndOffset;
+	short fitBlockId = -1, largestBlockId = -1;
+	ssize_t fitSize = 0, largestSize = 0, gapSize;
+	off_t gapOffset;
+	int numGaps = catalog->numBlocks + 1;
+
+	// next fit starts scanning from the first gap after the last allocation
+	short startBlockId = 0;
+	if (catalog->allocPolicy == ALLOC_NEXT_FIT)
+		while (startBlockId < catalog->numBlocks &&
+				catalog->blocks[startBlockId].blockOffset < catalog->nextFitOffset)
+			startBlockId++;
+
+	for (int i=0; i < numGaps; i++) {
+		short blockId = (startBlockId + i) % numGaps;
+		gapSize = getGap(blockId, &gapOffset, catalog);
+
+		// keep largest gap for fragmenting
+		if (gapSize > largestSize) {
+			largestBlockId = blockId;
+			largestSize = gapSize;
 		}
 
-		prevEndOffset = catalog->blocks[blockId].blockOffset + catalog->blocks[blockId].blockSize;
+		// check if current gap is a better fit
+		if (gapSize >= writeSize &&
+			(fitBlockId == -1 ||
+			 (catalog->allocPolicy == ALLOC_BEST_FIT && gapSize < fitSize) ||
+			 (catalog->allocPolicy == ALLOC_SEGREGATED && getSizeClass(gapSize) < getSizeClass(fitSize)))) {
+			fitBlockId = blockId;
+			fitSize = gapSize;
+			if (catalog->allocPolicy == ALLOC_NEXT_FIT)
+				break;
+		}
 	}
 
-	return gapBlockId;
+	if (fitBlockId == -1)
+		fitBlockId = largestBlockId;
+	if (fitBlockId != -1) {
+		newBlock->blockSize = getGap(fitBlockId, &gapOffset, catalog);
+		newBlock->blockOffset = gapOffset;
+	}
+	return fitBlockId;
 }
 
 /* Write block meta-data to catalog (without inserting data into vault).
@@ -139,47 +200,53 @@ void logBlockToGap(VaultBlock newBlock, short gapBlockId, ssize_t writeSize, Cat
 		newBlock.blockSize = writeSize;
 
 	// shift succeeding blocks right
-	for (int i=catalog->numBlocks; i > gapBlockId; i--) {
+	for (int i=catalog->numBlocks; i > gapBlockId; i--)
 		catalog->blocks[i] = catalog->blocks[i-1];
-		catalog->fat[catalog->blocks[i].fatEntryId].blockId[catalog->blocks[i].blockNum] = i;
-	}
 	// write block to blocks and fat
 	catalog->blocks[gapBlockId] = newBlock;
-	catalog->fat[newBlock.fatEntryId].blockId[newBlock.blockNum] = gapBlockId;
+	catalog->fat[newBlock.fatEntryId].numBlocks++;
 	catalog->numBlocks++;
+	catalog->nextFitOffset = newBlock.blockOffset + newBlock.blockSize;
 }
 
 /* Read block data from file and write it to vault.
  * Add delimiters at start and end of block.
+ * Computes block data checksum while copying.
  *
- * @param newBlock - block meta-data
+ * @param newBlock - block meta-data - checksum is set on success
  * @param fileId - file descriptor of file to read block from - must be open for read
  * @param vaultFd - file descriptor of vault file - must be open for read/write
  *
  * @return 0 for success, -1 for failure
  */
-int writeBlock(VaultBlock newBlock, int vaultFd, int fileFd) {
+int writeBlock(VaultBlock *newBlock, int vaultFd, int fileFd) {
 	// validate block is large enough for both delimiters
-	if (strlen(DELIM_START) + strlen(DELIM_END) > newBlock.blockSize) {
+	if (strlen(DELIM_START) + strlen(DELIM_END) > newBlock->blockSize) {
 		printf(SHORT_BLOCK_ERR);
 		return -1;
 	}
 
+	// allocate block space up front (vault file is sparse)
+	if (allocateData(vaultFd, newBlock->blockOffset, newBlock->blockSize) == -1) {
+		printf(VAULT_ALLOC_ERR, strerror(errno));
+		return -1;
+	}
+
 	// set position to start of block (+start delimiter
-	if (lseek(vaultFd, newBlock.blockOffset + strlen(DELIM_START), SEEK_SET) == -1) {
+	if (statsLseek(vaultFd, newBlock->blockOffset + strlen(DELIM_START), SEEK_SET) == -1) {
 		printf(VAULT_SEEK_ERR, strerror(errno));
 		return -1;
 	}
 
-	ssize_t tmpSize;
 	// copy file to block
-	if (copyData(fileFd, vaultFd, newBlock.blockSize - strlen(DELIM_START) - strlen(DELIM_END)) == -1) {
+	if (copyData(fileFd, vaultFd, newBlock->blockSize - strlen(DELIM_START) - strlen(DELIM_END),
+			&(newBlock->blockCrc)) == -1) {
 		printf(ADD_BLOCK_COPY_ERR);
 		return -1;
 	}
 
 	// write delimiters
-	return addDelim(newBlock, vaultFd);
+	return addDelim(*newBlock, vaultFd);
 }
 
 /* Add file to vault */
@@ -198,6 +265,12 @@ int addVaultFile(char* filePath, int vaultFd, Catalog catalog, int* updateCatalo
 	if (fileName == NULL) fileName = filePath;
 	else fileName++;
 
+	// check file name fits in name heap
+	if (strlen(fileName) > MAX_VAULT_FNAME) {
+		printf(FNAME_LEN_ERR);
+		return -1;
+	}
+
 	// check if file with same name already exists in vault
 	if (getFATEntryId(fileName, catalog) >= 0) {
 		printf(SAME_FNAME_ERR);
@@ -211,57 +284,49 @@ int addVaultFile(char* filePath, int vaultFd, Catalog catalog, int* updateCatalo
 		return -1;
 	}
 
-	// find location to fit file alphabetically and shift entries to make room
-	short fatEntryId = 0;
-	while (fatEntryId < catalog->numFiles &&
-			strcmp(fileName, catalog->fat[fatEntryId].fileName) > 0)
-		fatEntryId++;
-	for (int i=catalog->numFiles; i > fatEntryId; i--) {
-		catalog->fat[i] = catalog->fat[i-1]; // shift entries right
-		// fix blocks->fat pointers
-		for (int j=0; j<VAULT_BLOCK_NUM; j++)
-			if (catalog->fat[i].blockId[j] != -1)
-				catalog->blocks[catalog->fat[i].blockId[j]].fatEntryId = i;
-	}
-	catalog->numFiles++;
-
-	// add file to fat
+	// add file to fat (alphabetically)
+	short fatEntryId = insertFATEntry(fileName, catalog);
 	FATEntry *fatEntry = &(catalog->fat[fatEntryId]);
-	strcpy(fatEntry->fileName,fileName);
-	fatEntry->filePerm = fileStats.st_mode;
+	catalog->filePerm[fatEntryId] = fileStats.st_mode;
 	fatEntry->fileSize = fileStats.st_size;
-	for (int j=0; j<VAULT_BLOCK_NUM; j++)
-		fatEntry->blockId[j] = -1;
 	struct timeval insertionTime;
 	gettimeofday(&insertionTime,NULL);
-	fatEntry->insertionTime = insertionTime.tv_sec;
+	catalog->insertionTime[fatEntryId] = insertionTime.tv_sec;
 	catalog->modificationTime = insertionTime.tv_sec;
 
 
-	// add blocks
+	// add blocks - as many fragments as needed
 	ssize_t writeSize = fatEntry->fileSize;
 	ssize_t delimPadding = strlen(DELIM_START) + strlen(DELIM_END);
 	short blockNum = 0, gapBlockId =-1;
-	while (writeSize > 0 && blockNum < VAULT_BLOCK_NUM) {
-		VaultBlock newBlock = {fatEntryId, blockNum, 0, 0};
+	while (writeSize > 0) {
+		if (catalog->numBlocks == MAX_VAULT_BLOCKS) {
+			printf(MAX_BLOCKS_ERR);
+			return -1;
+		}
+		VaultBlock newBlock = {fatEntryId, blockNum, 0, 0, 0};
+		double startTime = statsStart();
 		gapBlockId = findGap(&newBlock, writeSize + delimPadding, catalog);
+		statsEnd(PHASE_PLACEMENT, startTime);
 
-		// log block to gap
-		if (newBlock.blockSize > delimPadding && gapBlockId != -1) {
-			logBlockToGap(newBlock, gapBlockId, writeSize + delimPadding, catalog);
-			writeSize -= (newBlock.blockSize - delimPadding);
-			blockNum++;
+		// no gap found - file does not fit in vault
+		if (newBlock.blockSize <= delimPadding || gapBlockId == -1) {
+			printf(CANNOT_FIT_ERR);
+			return -1;
 		}
-		else // no gap found
-			blockNum = VAULT_BLOCK_NUM;
-	}
 
-	// file does not fit in vault
-	if (writeSize > 0) {
-		printf(CANNOT_FIT_ERR);
-		return -1;
+		// log block to gap
+		logBlockToGap(newBlock, gapBlockId, writeSize + delimPadding, catalog);
+		writeSize -= (newBlock.blockSize - delimPadding);
+		blockNum++;
 	}
 
+	// update allocator statistics
+	catalog->allocStats.numAllocs++;
+	catalog->allocStats.numFragments += blockNum;
+	if (blockNum > catalog->allocStats.maxFragments)
+		catalog->allocStats.maxFragments = blockNum;
+
 	// write data to blocks;
 	// open file for read
 	int fileFd = -1;
@@ -271,26 +336,20 @@ int addVaultFile(char* filePath, int vaultFd, Catalog catalog, int* updateCatalo
 		return -1;
 	}
 	// write data
-	blockNum = 0;
-	while (blockNum < VAULT_BLOCK_NUM) {
-		if (fatEntry->blockId[blockNum] != -1) { // check block is not empty
-			VaultBlock newBlock = catalog->blocks[fatEntry->blockId[blockNum]];
-			if (writeBlock(newBlock, vaultFd, fileFd) == -1) {
-				// error writing block
-				close(fileFd);
-				// wipe blocks to prevent data corruption
-				for (int i=blockNum; i>=0; i--) {
-					newBlock = catalog->blocks[fatEntry->blockId[i]];
-					if (wipeDelim(newBlock, vaultFd) == -1)
-						// failed wiping some of the blocks
-						printf(DATA_CORRUPTION_ERR);
-				}
-				return -1;
+	short blockIds[MAX_VAULT_BLOCKS];
+	short numBlocks = getFileBlocks(fatEntryId, catalog, blockIds);
+	for (blockNum = 0; blockNum < numBlocks; blockNum++) {
+		if (writeBlock(&(catalog->blocks[blockIds[blockNum]]), vaultFd, fileFd) == -1) {
+			// error writing block
+			close(fileFd);
+			// wipe blocks to prevent data corruption
+			for (int i=blockNum; i>=0; i--) {
+				if (wipeDelim(catalog->blocks[blockIds[i]], vaultFd) == -1)
+					// failed wiping some of the blocks
+					printf(DATA_CORRUPTION_ERR);
 			}
-		blockNum++;
+			return -1;
 		}
-		// go to end if reached empty block
-		else blockNum = VAULT_BLOCK_NUM;
 	}
 
 	close(fileFd);
@@ -304,6 +363,7 @@ int addVaultFile(char* filePath, int vaultFd, Catalog catalog, int* updateCatalo
 /* ********** ********** ********** ********** ********** ********** ********** */
 
 /* Remove block from vault - lazy remove - wipes delimiters and updates catalog.
+ * Releases disk space of block data between delimiters (punches a hole).
  * Shifts blocks in catalog to leave no gaps in array (only in catalog, not in vault)
  *
  * @param blockId - index of block to be removed.
@@ -319,17 +379,24 @@ int rmBlock(short blockId, int vaultFd, Catalog catalog) {
 	VaultBlock vaultBlock = catalog->blocks[blockId];
 
 	// update catalog
-	for (int i=blockId; i<catalog->numBlocks-1; i++) { // shift blocks left
+	for (int i=blockId; i<catalog->numBlocks-1; i++) // shift blocks left
 		catalog->blocks[i] = catalog->blocks[i+1];
-		catalog->fat[catalog->blocks[i].fatEntryId].blockId[catalog->blocks[i].blockNum] = i;
-	}
 	// delete last block
-	catalog->fat[vaultBlock.fatEntryId].blockId[vaultBlock.blockNum] = -1;
+	catalog->fat[vaultBlock.fatEntryId].numBlocks--;
 	catalog->blocks[catalog->numBlocks-1].fatEntryId = -1;
 	catalog->numBlocks --;
 
 	// wipe delimiters
-	return wipeDelim(vaultBlock, vaultFd);
+	if (wipeDelim(vaultBlock, vaultFd) == -1)
+		return -1;
+
+	// release block data
+	if (punchHole(vaultFd, vaultBlock.blockOffset + strlen(DELIM_START),
+			vaultBlock.blockSize - strlen(DELIM_START) - strlen(DELIM_END)) == -1) {
+		printf(VAULT_PUNCH_ERR, strerror(errno));
+		return -1;
+	}
+	return 0;
 }
 
 /* Remove file from vault by file name (if file in vault) */
@@ -344,9 +411,10 @@ int rmVaultFile(char* fileName, int vaultFd, Catalog catalog, int* updateCatalog
 		return -1;
 	}
 
-	// delete blocks
-	for (int blockNum = 0; blockNum < VAULT_BLOCK_NUM; blockNum++) {
-		if(rmBlock(catalog->fat[fatEntryId].blockId[blockNum], vaultFd, catalog) == -1) {
+	// delete blocks - backwards so shifting does not skip blocks
+	for (int blockId = catalog->numBlocks-1; blockId >= 0; blockId--) {
+		if (catalog->blocks[blockId].fatEntryId == fatEntryId &&
+			rmBlock(blockId, vaultFd, catalog) == -1) {
 			// failed removing block - cannot be fixed
 			printf(DATA_CORRUPTION_ERR);
 			return -1;
@@ -354,17 +422,7 @@ int rmVaultFile(char* fileName, int vaultFd, Catalog catalog, int* updateCatalog
 	}
 
 	// delete fat entry
-	for (int i=fatEntryId; i< catalog->numFiles-1; i++) {
-		catalog->fat[i] = catalog->fat[i+1]; // shift entries left
-		// fix blocks->fat pointers
-		for (int j=0; j<VAULT_BLOCK_NUM; j++)
-			if (catalog->fat[i].blockId[j] != -1)
-				catalog->blocks[catalog->fat[i].blockId[j]].fatEntryId = i;
-	}
-	// nullify last entry
-	for (int j=0; j<VAULT_BLOCK_NUM; j++)
-		catalog->fat[catalog->numFiles-1].blockId[j] = -1;
-	catalog->numFiles --;
+	removeFATEntry(fatEntryId, catalog);
 
 	*updateCatalog = 1;
 	sprintf(msg, RM_SUCCESS_MSG, fileName);
@@ -376,31 +434,43 @@ int rmVaultFile(char* fileName, int vaultFd, Catalog catalog, int* updateCatalog
 /* ********** ********** ********** ********** ********** ********** ********** */
 
 /* Read block from vault and write it to file
+ * Optionally verifies block data checksum while copying.
  *
  * @param blockId - index of block to be removed.
  * 				    if -1 then block not in use so does nothing and returns success
  * @param fileId - file descriptor of file to write block to - must be open for write
  * @param vaultFd - file descriptor of vault file - must be open for read/write
  * @param catalog - vault meta-data
+ * @param verify - 1 to verify block checksum, 0 to skip
  *
- * @return 0 for success, -1 for failure
+ * @return 0 for success, -1 for failure (or checksum mismatch)
  */
-int readBlock(short blockId, int fileFd, int vaultFd, Catalog catalog) {
+int readBlock(short blockId, int fileFd, int vaultFd, Catalog catalog, int verify) {
 	if (blockId == -1) // block not used
 		return 0;
 	VaultBlock vaultBlock = catalog->blocks[blockId];
 
-	if (lseek(vaultFd, vaultBlock.blockOffset + strlen(DELIM_START), SEEK_SET) == -1) {
+	if (statsLseek(vaultFd, vaultBlock.blockOffset + strlen(DELIM_START), SEEK_SET) == -1) {
 		printf(VAULT_SEEK_ERR, strerror(errno));
 		return -1;
 	}
 
 	// copy block to file
-	return copyData(vaultFd, fileFd, vaultBlock.blockSize - strlen(DELIM_START) - strlen(DELIM_END));
+	unsigned int crc;
+	if (copyData(vaultFd, fileFd, vaultBlock.blockSize - strlen(DELIM_START) - strlen(DELIM_END),
+			verify ? &crc : NULL) == -1)
+		return -1;
+
+	// verify checksum
+	if (verify && crc != vaultBlock.blockCrc) {
+		printf(FETCH_CRC_ERR);
+		return -1;
+	}
+	return 0;
 }
 
 /* Fetch file from vault by file name (if file in vault) */
-int fetchVaultFile(char* fileName, int vaultFd, Catalog catalog, char *msg) {
+int fetchVaultFile(char* fileName, int vaultFd, Catalog catalog, int verify, char *msg) {
 
 	// check if filename exists
 	int fatEntryId = getFATEntryId(fileName, catalog);
@@ -411,15 +481,17 @@ int fetchVaultFile(char* fileName, int vaultFd, Catalog catalog, char *msg) {
 
 	// create file
 	int fileFd = -1;
-	fileFd = open(fileName,O_WRONLY | O_CREAT | O_TRUNC, catalog->fat[fatEntryId].filePerm);
+	fileFd = open(fileName,O_WRONLY | O_CREAT | O_TRUNC, catalog->filePerm[fatEntryId]);
 	if (fileFd < 0) {
 		printf(FETCH_CREATE_ERR, strerror(errno));
 		return -1;
 	}
 
 	// copy data from blocks to file
-	for (int blockNum = 0; blockNum < VAULT_BLOCK_NUM; blockNum++) {
-		if(readBlock(catalog->fat[fatEntryId].blockId[blockNum], fileFd, vaultFd, catalog) == -1) {
+	short blockIds[MAX_VAULT_BLOCKS];
+	short numBlocks = getFileBlocks(fatEntryId, catalog, blockIds);
+	for (int blockNum = 0; blockNum < numBlocks; blockNum++) {
+		if(readBlock(blockIds[blockNum], fileFd, vaultFd, catalog, verify) == -1) {
 			// failed copying block
 			printf(FETCH_BLOCK_ERR);
 			close(fileFd);
@@ -431,7 +503,7 @@ int fetchVaultFile(char* fileName, int vaultFd, Catalog catalog, char *msg) {
 	close(fileFd);
 
 	// fix permissions
-	if (chmod(fileName, catalog->fat[fatEntryId].filePerm) == -1) {
+	if (chmod(fileName, catalog->filePerm[fatEntryId]) == -1) {
 		printf(FETCH_PERMS_ERR, strerror(errno));
 		return -1;
 	}
@@ -444,11 +516,59 @@ int fetchVaultFile(char* fileName, int vaultFd, Catalog catalog, char *msg) {
 /* ********** ********** **********   DEFRAG   ********** ********** ********** */
 /* ********** ********** ********** ********** ********** ********** ********** */
 
+/* Move block to a new offset in vault (new offset must be before current offset
+ * or not overlap it). Wipes delimiters before copy and returns them at the end.
+ * Releases disk space of the part of the old block not covered by the new one.
+ * Updates block offset in catalog.
+ *
+ * @param vaultBlock - block meta-data - offset is updated on success
+ * @param newOffset - offset to move block to
+ * @param vaultFd - file descriptor of vault file - must be open for read/write
+ * @param vaultReadFd - second file descriptor of vault file - must be open for read
+ *
+ * @return 0 for success, -1 for failure
+ */
+int moveBlock(VaultBlock *vaultBlock, off_t newOffset, int vaultFd, int vaultReadFd) {
+	// remove delimeters before move
+	if (wipeDelim(*vaultBlock, vaultFd) == -1) {
+		printf(MOVE_DELIM_ERR);
+		return -1;
+	}
+	// go to start of block
+	if ((statsLseek(vaultFd, newOffset, SEEK_SET) == -1) ||
+		(statsLseek(vaultReadFd, vaultBlock->blockOffset, SEEK_SET) == -1)) {
+		printf(VAULT_SEEK_ERR, strerror(errno));
+		return -1;
+	}
+	// move block
+	if (copyData(vaultReadFd, vaultFd, vaultBlock->blockSize, NULL) == -1) {
+		printf(MOVE_BLOCK_COPY_ERR);
+		return -1;
+	}
+	// fix catalog
+	off_t oldOffset = vaultBlock->blockOffset;
+	vaultBlock->blockOffset = newOffset;
+	// return delimiters
+	if (addDelim(*vaultBlock, vaultFd) == -1) {
+		printf(MOVE_DELIM_ERR);
+		return -1;
+	}
+
+	// release vacated space
+	off_t vacatedOffset = newOffset + vaultBlock->blockSize;
+	if (vacatedOffset < oldOffset)
+		vacatedOffset = oldOffset;
+	if (punchHole(vaultFd, vacatedOffset, oldOffset + vaultBlock->blockSize - vacatedOffset) == -1) {
+		printf(VAULT_PUNCH_ERR, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
 /* Defragment vault - shift all data blocks to close gaps between them. */
 int defragVault(char* vaultFileName, int vaultFd, Catalog catalog, int* updateCatalog, char* msg) {
 	// set for rollback
 	*updateCatalog = 0;
-	int res = 0;
 
 	// open vault read-only
 	int vaultReadFd = -1;
@@ -464,45 +584,254 @@ int defragVault(char* vaultFileName, int vaultFd, Catalog catalog, int* updateCa
 		vaultBlock = &(catalog->blocks[blockId]);
 
 		// close gap
-		if (vaultBlock->blockOffset - prevEndOffset > 0) {
-			// remove delimeters before move
-			if (wipeDelim(*vaultBlock, vaultFd) == -1) {
-				printf(DEFRAG_DELIM_ERR);
-				res = -1;
-			}
-			// go to start of block
-			else if ((lseek(vaultFd, prevEndOffset, SEEK_SET) == -1) ||
-				(lseek(vaultReadFd, vaultBlock->blockOffset, SEEK_SET) == -1)) {
-				printf(VAULT_SEEK_ERR, strerror(errno));
-				res = -1;
-			}
-			// move block
-			else if (copyData(vaultReadFd, vaultFd, vaultBlock->blockSize) == -1) {
-				printf(MOVE_BLOCK_COPY_ERR);
-				res = -1;
-			}
-			// fix catalog
-			vaultBlock->blockOffset = prevEndOffset;
-			// return delimiters
-			if (res != -1 && addDelim(*vaultBlock, vaultFd) == -1) {
-				printf(DEFRAG_DELIM_ERR);
-				res = -1;
-			}
-
+		if (vaultBlock->blockOffset - prevEndOffset > 0 &&
+			moveBlock(vaultBlock, prevEndOffset, vaultFd, vaultReadFd) == -1) {
 			// error moving block
-			if (res == -1) {
-				printf(DATA_CORRUPTION_ERR);
-				close(vaultReadFd);
-				return -1;
+			printf(DATA_CORRUPTION_ERR);
+			close(vaultReadFd);
+			return -1;
+		}
+
+		prevEndOffset += vaultBlock->blockSize;
+	}
+
+	close(vaultReadFd);
+	catalog->nextFitOffset = prevEndOffset;
+	*updateCatalog = 1;
+	sprintf(msg, DEFRAG_SUCCESS_MSG);
+	return 0;
+}
+
+/* ********** ********** ********** ********** ********** ********** ********** */
+/* ********** ********** **********   RESIZE   ********** ********** ********** */
+/* ********** ********** ********** ********** ********** ********** ********** */
+
+/* Grow vault file by given size */
+int growVault(ssize_t growSize, int vaultFd, Catalog catalog, int* updateCatalog, char* msg) {
+	// set for rollback
+	*updateCatalog = 0;
+
+	// stretch vault - sparse, space is allocated when files are added
+	if (ftruncate(vaultFd, catalog->vaultSize + growSize) == -1) {
+		printf(VAULT_STRECH_ERR, strerror(errno));
+		return -1;
+	}
+
+	// the gap after the last block now extends to the new end of vault
+	catalog->vaultSize += growSize;
+
+	char sizeStr[10];
+	formatSize(sizeStr, catalog->vaultSize);
+	*updateCatalog = 1;
+	sprintf(msg, RESIZE_SUCCESS_MSG, sizeStr);
+	return 0;
+}
+
+/* Shrink vault file by given size */
+int shrinkVault(char* vaultFileName, ssize_t shrinkSize, int vaultFd, Catalog catalog,
+		int* updateCatalog, char* msg) {
+	// set for rollback
+	*updateCatalog = 0;
+
+	// validate vault is large enough
+	ssize_t newSize = catalog->vaultSize - shrinkSize;
+	if (newSize < (ssize_t) sizeof(*catalog)) {
+		printf(VAULT_SIZE_ERR);
+		return -1;
+	}
+
+	// open vault read-only
+	int vaultReadFd = -1;
+	vaultReadFd = open(vaultFileName, O_RDONLY);
+	if (vaultReadFd == -1) {
+		printf(VAULT_OPEN_ERR, strerror(errno));
+		return -1;
+	}
+
+	// relocate blocks crossing the new end of vault - last block first
+	while (catalog->numBlocks > 0 &&
+			catalog->blocks[catalog->numBlocks-1].blockOffset +
+			catalog->blocks[catalog->numBlocks-1].blockSize > newSize) {
+		short lastBlockId = catalog->numBlocks-1;
+		VaultBlock vaultBlock = catalog->blocks[lastBlockId];
+
+		// find smallest gap (cut at new end of vault) that fits whole block
+		short gapBlockId = -1;
+		ssize_t gapSize, fitSize = 0;
+		off_t gapOffset, fitOffset = 0;
+		for (short blockId=0; blockId <= lastBlockId; blockId++) {
+			gapSize = getGap(blockId, &gapOffset, catalog);
+			if (blockId == lastBlockId || gapOffset + gapSize > newSize)
+				gapSize = newSize - gapOffset;
+			if (gapSize >= vaultBlock.blockSize && (gapBlockId == -1 || gapSize < fitSize)) {
+				gapBlockId = blockId;
+				fitSize = gapSize;
+				fitOffset = gapOffset;
 			}
+		}
 
+		// no room for block - leave vault at current size
+		// blocks already relocated are valid, so catalog is still flushed
+		if (gapBlockId == -1) {
+			printf(SHRINK_FIT_ERR);
+			close(vaultReadFd);
+			*updateCatalog = 1;
+			return -1;
+		}
 
+		// move block data
+		if (moveBlock(&vaultBlock, fitOffset, vaultFd, vaultReadFd) == -1) {
+			printf(DATA_CORRUPTION_ERR);
+			close(vaultReadFd);
+			return -1;
 		}
 
-		prevEndOffset += vaultBlock->blockSize;
+		// move block in catalog to keep blocks sorted by offset
+		for (int i=lastBlockId; i > gapBlockId; i--)
+			catalog->blocks[i] = catalog->blocks[i-1];
+		catalog->blocks[gapBlockId] = vaultBlock;
+	}
+	close(vaultReadFd);
+
+	// cut vault file
+	if (ftruncate(vaultFd, newSize) == -1) {
+		printf(VAULT_TRUNCATE_ERR, strerror(errno));
+		*updateCatalog = 1;
+		return -1;
 	}
+	catalog->vaultSize = newSize;
+	if (catalog->nextFitOffset > newSize)
+		catalog->nextFitOffset = sizeof(*catalog);
 
+	char sizeStr[10];
+	formatSize(sizeStr, catalog->vaultSize);
 	*updateCatalog = 1;
-	sprintf(msg, DEFRAG_SUCCESS_MSG);
-	return res;
+	sprintf(msg, RESIZE_SUCCESS_MSG, sizeStr);
+	return 0;
+}
+
+/* ********** ********** ********** ********** ********** ********** ********** */
+/* ********** ********** **********   VERIFY   ********** ********** ********** */
+/* ********** ********** ********** ********** ********** ********** ********** */
+
+typedef struct verify_task_t {
+	int vaultFd;
+	Catalog catalog;
+	short firstBlockId;
+	short lastBlockId;
+	char* corruptBlocks;
+} VerifyTask;
+
+/* Verify a single block - delimiters and data checksum.
+ * Reads block with pread so several threads can share the vault file descriptor.
+ *
+ * @param vaultBlock - block meta-data
+ * @param vaultFd - file descriptor of vault file - must be open for read
+ * @param buffer - read buffer of VERIFY_BUFFER_SIZE bytes
+ *
+ * @return 1 if block is valid, 0 if corrupt
+ */
+int verifyBlock(VaultBlock vaultBlock, int vaultFd, char* buffer) {
+	ssize_t delimSize = strlen(DELIM_START);
+	ssize_t dataSize = vaultBlock.blockSize - delimSize - strlen(DELIM_END);
+
+	// check delimiters
+	if (statsPread(vaultFd, buffer, delimSize, vaultBlock.blockOffset) != delimSize ||
+		strncmp(buffer, DELIM_START, delimSize) != 0 ||
+		statsPread(vaultFd, buffer, strlen(DELIM_END), vaultBlock.blockOffset + delimSize + dataSize) !=
+				(ssize_t) strlen(DELIM_END) ||
+		strncmp(buffer, DELIM_END, strlen(DELIM_END)) != 0)
+		return 0;
+
+	// check data checksum
+	unsigned int crc = 0;
+	off_t offset = vaultBlock.blockOffset + delimSize;
+	while (dataSize > 0) {
+		ssize_t readSize = (dataSize < VERIFY_BUFFER_SIZE) ? dataSize : VERIFY_BUFFER_SIZE;
+		if (statsPread(vaultFd, buffer, readSize, offset) != readSize)
+			return 0;
+		crc = crc32c(crc, buffer, readSize);
+		offset += readSize;
+		dataSize -= readSize;
+	}
+	return crc == vaultBlock.blockCrc;
+}
+
+/* Verify thread - verifies a contiguous range of blocks and marks corrupt blocks
+ *
+ * @param taskPtr - pointer to VerifyTask with range of blocks to verify
+ */
+void* verifyBlocks(void* taskPtr) {
+	VerifyTask* task = (VerifyTask*) taskPtr;
+	char* buffer = (char*) malloc(VERIFY_BUFFER_SIZE);
+	for (int blockId = task->firstBlockId; blockId < task->lastBlockId; blockId++)
+		task->corruptBlocks[blockId] = (buffer == NULL) ||
+			!verifyBlock(task->catalog->blocks[blockId], task->vaultFd, buffer);
+	free(buffer);
+	return NULL;
+}
+
+/* Verify all vault blocks */
+int verifyVault(int vaultFd, Catalog catalog, char* msg) {
+	char corruptBlocks[MAX_VAULT_BLOCKS] = {0};
+	VerifyTask tasks[VERIFY_MAX_THREADS];
+	pthread_t threads[VERIFY_MAX_THREADS];
+
+	// one thread per core - each gets a contiguous range of blocks of similar total size
+	int numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads > VERIFY_MAX_THREADS) numThreads = VERIFY_MAX_THREADS;
+	if (numThreads > catalog->numBlocks) numThreads = catalog->numBlocks;
+	if (numThreads < 1) numThreads = 1;
+
+	ssize_t totalSize = 0, rangeSize = 0;
+	for (int blockId=0; blockId < catalog->numBlocks; blockId++)
+		totalSize += catalog->blocks[blockId].blockSize;
+
+	short blockId = 0;
+	for (int i=0; i < numThreads; i++) {
+		tasks[i].vaultFd = vaultFd;
+		tasks[i].catalog = catalog;
+		tasks[i].corruptBlocks = corruptBlocks;
+		tasks[i].firstBlockId = blockId;
+		while (blockId < catalog->numBlocks &&
+				(i == numThreads-1 || rangeSize < totalSize / numThreads * (i+1)))
+			rangeSize += catalog->blocks[blockId++].blockSize;
+		tasks[i].lastBlockId = blockId;
+	}
+
+	// run threads - the first range runs in the calling thread
+	int numStarted = 1;
+	for (; numStarted < numThreads; numStarted++) {
+		if (pthread_create(&threads[numStarted], NULL, verifyBlocks, &tasks[numStarted])) {
+			printf(VERIFY_THREAD_ERR);
+			break;
+		}
+	}
+	verifyBlocks(&tasks[0]);
+	for (int i=1; i < numStarted; i++)
+		pthread_join(threads[i], NULL);
+	// verify ranges of threads that failed to start
+	for (int i=numStarted; i < numThreads; i++)
+		verifyBlocks(&tasks[i]);
+
+	// report corrupt files
+	int numCorrupt = 0;
+	for (int fatEntryId=0; fatEntryId < catalog->numFiles; fatEntryId++) {
+		short blockIds[MAX_VAULT_BLOCKS];
+		short numBlocks = getFileBlocks(fatEntryId, catalog, blockIds);
+		for (int blockNum=0; blockNum < numBlocks; blockNum++) {
+			if (corruptBlocks[blockIds[blockNum]]) {
+				printf(CORRUPT_FILE_MSG, getFileName(fatEntryId, catalog));
+				numCorrupt++;
+				break;
+			}
+		}
+	}
+
+	if (numCorrupt > 0) {
+		printf(VERIFY_CORRUPT_ERR, numCorrupt, catalog->numFiles);
+		return -1;
+	}
+	sprintf(msg, VERIFY_SUCCESS_MSG, catalog->numFiles);
+	return 0;
 }
@@ -5,7 +5,9 @@
 
 /* Add file to vault under the following restrictions
  *   - no file of same name already in vault
- *   - file can be fit in vault in up to 3 fragments
+ *   - file can be fit in vault gaps (in as many fragments as needed,
+ *     up to MAX_VAULT_BLOCKS blocks in the whole vault)
+ * Gaps are chosen according to the vault allocation policy.
  *
  * On failure rolls back catalog and tries to wipe delimiters -
  * if this fails vault may be corrupted for the tester.
@@ -23,7 +25,8 @@
 int addVaultFile(char* filePath, int vaultFd, Catalog catalog, int* updateCatalog, char* msg);
 
 /* Remove file from vault by file name (if file in vault)
- * Lazy remove - only removes from catalog and wipes delimiters.
+ * Lazy remove - only removes from catalog, wipes delimiters and releases
+ * the disk space of the file data.
  *
  * If delimiter wipe fails, vault data might be corrupted for the tester.
  * The catalog is rolled back as if the file was not deleted.
@@ -48,12 +51,14 @@ int rmVaultFile(char* fileName, int vaultFd, Catalog catalog, int* updateCatalog
  * @param fileName - name of file in vault to be fetched (fails if does not exist)
  * @param vaultFd - file descriptor of vault file - must be open for read/write
  * @param catalog - vault meta-data
+ * @param verify - 1 to verify checksum of each block while fetching
+ * 				   (fails on mismatch), 0 to skip
  * @param msg - return parameter - formatted success message on success
  * 				otherwise left untouched
  *
  * @return 0 for success, -1 for failure
  */
-int fetchVaultFile(char* fileName, int vaultFd, Catalog catalog, char* msg);
+int fetchVaultFile(char* fileName, int vaultFd, Catalog catalog, int verify, char* msg);
 
 /* Defragment vault - shift all data blocks to close gaps between them.
  * Shifts first block to sit just after the catalog.
@@ -73,4 +78,54 @@ int fetchVaultFile(char* fileName, int vaultFd, Catalog catalog, char* msg);
  */
 int defragVault(char* vaultFileName, int vaultFd, Catalog catalog, int* updateCatalog, char* msg);
 
+/* Grow vault - extends vault file by given size and allocates the new space.
+ * The new space joins the gap after the last block, no data is moved.
+ *
+ * @param growSize - number of bytes to add to vault
+ * @param vaultFd - file descriptor of vault file - must be open for read/write
+ * @param catalog - vault meta-data
+ * @param updateCatalog - return parameter - on success is set to 1 to flush
+ * 						  catalog to vault file when done. Otherwise set to 0.
+ * @param msg - return parameter - formatted success message on success
+ * 				otherwise left untouched
+ *
+ * @return 0 for success, -1 for failure
+ */
+int growVault(ssize_t growSize, int vaultFd, Catalog catalog, int* updateCatalog, char* msg);
+
+/* Shrink vault - cuts given size from the end of the vault file.
+ * Only blocks crossing the new end of vault are relocated (each to the
+ * smallest gap it fits in whole), all other blocks are left untouched.
+ * If some block cannot be relocated the vault keeps its size - blocks
+ * relocated so far stay valid and the catalog is still flushed.
+ *
+ * @param vaultFileName - path of vault file - to open a second read only file descriptor
+ * @param shrinkSize - number of bytes to remove from vault
+ * @param vaultFd - file descriptor of vault file - must be open for read/write
+ * @param catalog - vault meta-data
+ * @param updateCatalog - return parameter - set to 1 to flush catalog to
+ * 						  vault file when done (also when some blocks were
+ * 						  already relocated). Otherwise set to 0.
+ * @param msg - return parameter - formatted success message on success
+ * 				otherwise left untouched
+ *
+ * @return 0 for success, -1 for failure
+ */
+int shrinkVault(char* vaultFileName, ssize_t shrinkSize, int vaultFd, Catalog catalog,
+		int* updateCatalog, char* msg);
+
+/* Verify integrity of all vault blocks - delimiters and data checksum.
+ * Blocks are split into contiguous ranges verified in parallel
+ * (one thread per core, up to VERIFY_MAX_THREADS).
+ * Outputs name of each file with a corrupt block.
+ *
+ * @param vaultFd - file descriptor of vault file - must be open for read
+ * @param catalog - vault meta-data
+ * @param msg - return parameter - formatted success message on success
+ * 				otherwise left untouched
+ *
+ * @return 0 if all files are valid, -1 if some file is corrupt
+ */
+int verifyVault(int vaultFd, Catalog catalog, char* msg);
+
 #endif /* VAULT_FILES_H_ */
@@ -0,0 +1,71 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "vault_stats.h"
+#include "vault_consts.h"
+
+VaultStats vaultStats;
+
+/* Get start time of a phase */
+double statsStart() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Account time of a phase since its start */
+void statsEnd(int phase, double startTime) {
+	vaultStats.phaseTime[phase] += statsStart() - startTime;
+	vaultStats.phaseCalls[phase]++;
+}
+
+/* Counted wrappers of read / write / pread / lseek / fallocate */
+ssize_t statsRead(int fd, void* buffer, size_t count) {
+	ssize_t res = read(fd, buffer, count);
+	__sync_fetch_and_add(&vaultStats.syscalls[SYSCALL_READ], 1);
+	if (res > 0) __sync_fetch_and_add(&vaultStats.bytesRead, res);
+	return res;
+}
+
+ssize_t statsWrite(int fd, const void* buffer, size_t count) {
+	ssize_t res = write(fd, buffer, count);
+	__sync_fetch_and_add(&vaultStats.syscalls[SYSCALL_WRITE], 1);
+	if (res > 0) __sync_fetch_and_add(&vaultStats.bytesWritten, res);
+	return res;
+}
+
+ssize_t statsPread(int fd, void* buffer, size_t count, off_t offset) {
+	ssize_t res = pread(fd, buffer, count, offset);
+	__sync_fetch_and_add(&vaultStats.syscalls[SYSCALL_READ], 1);
+	if (res > 0) __sync_fetch_and_add(&vaultStats.bytesRead, res);
+	return res;
+}
+
+off_t statsLseek(int fd, off_t offset, int whence) {
+	__sync_fetch_and_add(&vaultStats.syscalls[SYSCALL_SEEK], 1);
+	return lseek(fd, offset, whence);
+}
+
+int statsFallocate(int fd, int mode, off_t offset, off_t length) {
+	__sync_fetch_and_add(&vaultStats.syscalls[SYSCALL_FALLOCATE], 1);
+	return fallocate(fd, mode, offset, length);
+}
+
+/* Output statistics of current invocation */
+void printStats() {
+	char* phaseNames[NUM_PHASES] = {"catalog load", "catalog store", "placement",
+			"payload copy", "delimiter write"};
+	char* syscallNames[NUM_SYSCALLS] = {"read", "write", "lseek", "fallocate"};
+
+	printf(STATS_HEADER_MSG, "phase", "calls", "time ms");
+	for (int i=0; i < NUM_PHASES; i++)
+		printf(STATS_PHASE_MSG, phaseNames[i], vaultStats.phaseCalls[i], vaultStats.phaseTime[i]);
+	printf(STATS_BYTES_MSG, "bytes read", vaultStats.bytesRead);
+	printf(STATS_BYTES_MSG, "bytes written", vaultStats.bytesWritten);
+	for (int i=0; i < NUM_SYSCALLS; i++)
+		printf(STATS_SYSCALL_MSG, syscallNames[i], vaultStats.syscalls[i]);
+}
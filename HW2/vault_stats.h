@@ -0,0 +1,64 @@
+#ifndef VAULT_STATS_H_
+#define VAULT_STATS_H_
+
+#include <sys/types.h>
+
+// instrumented phases
+#define PHASE_CATALOG_LOAD 0
+#define PHASE_CATALOG_STORE 1
+#define PHASE_PLACEMENT 2
+#define PHASE_PAYLOAD_COPY 3
+#define PHASE_DELIM_WRITE 4
+#define NUM_PHASES 5
+
+// instrumented system calls
+#define SYSCALL_READ 0
+#define SYSCALL_WRITE 1
+#define SYSCALL_SEEK 2
+#define SYSCALL_FALLOCATE 3
+#define NUM_SYSCALLS 4
+
+typedef struct vault_stats_t VaultStats;
+
+struct vault_stats_t {
+	double phaseTime[NUM_PHASES];
+	long phaseCalls[NUM_PHASES];
+	long syscalls[NUM_SYSCALLS];
+	long long bytesRead;
+	long long bytesWritten;
+};
+
+// statistics of current invocation
+extern VaultStats vaultStats;
+
+/* Get start time of a phase
+ *
+ * @return current time in milliseconds
+ */
+double statsStart();
+
+/* Account time of a phase since its start
+ *
+ * @param phase - phase id (PHASE_*)
+ * @param startTime - start time of phase as returned by statsStart
+ */
+void statsEnd(int phase, double startTime);
+
+/* Counted wrappers of read / write / pread / lseek / fallocate.
+ * Same parameters and return values as the system calls.
+ * Safe to call from several threads.
+ */
+ssize_t statsRead(int fd, void* buffer, size_t count);
+ssize_t statsWrite(int fd, const void* buffer, size_t count);
+ssize_t statsPread(int fd, void* buffer, size_t count, off_t offset);
+off_t statsLseek(int fd, off_t offset, int whence);
+int statsFallocate(int fd, int mode, off_t offset, off_t length);
+
+/* Output statistics of current invocation:
+ *   - time and number of calls of each phase
+ *   - bytes read and written
+ *   - number of system calls of each type
+ */
+void printStats();
+
+#endif /* VAULT_STATS_H_ */
@@ -0,0 +1,86 @@
+#!/bin/bash
+
+# Benchmarks the dispatcher against grep -o | wc -l (as real_count.sh does).
+# Generates text files of each size from man.txt, runs every execution mode
+# under every chunk size setting and checks the count against grep.
+# Writes one CSV line per run: size, mode, chunk size, best time of all runs,
+# throughput and correctness.
+#
+# Usage: ./bench_count.sh [-o <csv file>] [-r <runs>] [-d <work dir>] [sizes...]
+# sizes take a K/M/G suffix, e.g. ./bench_count.sh 4K 1M 256M 4G
+
+TEST_CHAR=e
+OUT=bench_count.csv
+RUNS=3
+WORK_DIR=/tmp/count_bench
+while getopts "o:r:d:" OPT; do
+    case $OPT in
+        o) OUT=$OPTARG ;;
+        r) RUNS=$OPTARG ;;
+        d) WORK_DIR=$OPTARG ;;
+        *) echo "Usage: ./bench_count.sh [-o <csv file>] [-r <runs>] [-d <work dir>] [sizes...]"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+SIZES=${@:-4K 64K 1M 16M 256M 1G}
+CHUNKS="auto 256K 4M 64M"
+# execution mode name and dispatcher flags
+MODES=("processes:" "threads:-t" "threads-read:-t -m read" "threads-populate:-t -m populate")
+
+bash build.sh 2> /dev/null || exit 1
+mkdir -p $WORK_DIR
+
+# size with K/M/G suffix in bytes
+to_bytes() {
+    numfmt --from=iec $1
+}
+
+# best wall time in ns of RUNS runs of a command, output of last run in $LAST
+best_time() {
+    BEST=""
+    for ((i=0; i<RUNS; i++)); do
+        START=$(date +%s%N)
+        LAST=$("$@")
+        END=$(date +%s%N)
+        T=$((END - START))
+        if [ -z "$BEST" ] || [ $T -lt $BEST ]; then
+            BEST=$T
+        fi
+    done
+}
+
+# appends a CSV line - size, mode, chunk, ns, count, expected
+report() {
+    awk -v size=$1 -v mode=$2 -v chunk=$3 -v ns=$4 -v count=$5 -v expected=$6 'BEGIN {
+        printf "%d,%s,%s,%.6f,%.1f,%d,%d,%s\n", size, mode, chunk, ns / 1e9,
+            (ns > 0) ? size / 1048576 / (ns / 1e9) : 0, count, expected,
+            (count == expected) ? "ok" : "MISMATCH" }' | tee -a $OUT
+}
+
+echo "size_bytes,mode,chunk_size,seconds,mb_per_s,count,expected,correct" | tee $OUT
+for SIZE in $SIZES; do
+    BYTES=$(to_bytes $SIZE)
+    FILE=$WORK_DIR/bench_$SIZE.txt
+    if [ ! -f $FILE ] || [ $(stat -c %s $FILE) != $BYTES ]; then
+        yes "$(cat man.txt)" | head -c $BYTES > $FILE
+    fi
+
+    # baseline
+    best_time bash -c "grep -o $TEST_CHAR $FILE | wc -l"
+    EXPECTED=$LAST
+    report $BYTES grep - $BEST $EXPECTED $EXPECTED
+
+    for MODE in "${MODES[@]}"; do
+        NAME=${MODE%%:*}
+        FLAGS=${MODE#*:}
+        for CHUNK in $CHUNKS; do
+            CHUNK_FLAG=""
+            [ $CHUNK != auto ] && CHUNK_FLAG="-c $CHUNK"
+            best_time bash -c "./dispatcher $FLAGS $CHUNK_FLAG $TEST_CHAR $FILE | grep -o 'appears [0-9]* times' | grep -o '[0-9]*'"
+            report $BYTES $NAME $CHUNK $BEST ${LAST:-0} $EXPECTED
+        done
+    done
+
+    best_time bash -c "./dispatcher $TEST_CHAR - < $FILE | grep -o 'appears [0-9]* times' | grep -o '[0-9]*'"
+    report $BYTES stream - $BEST ${LAST:-0} $EXPECTED
+done
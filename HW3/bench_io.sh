@@ -0,0 +1,48 @@
+#!/bin/bash
+
+# Compares dispatcher io modes (counter processes and threads) on a file.
+# Prints the best wall time of several runs for every mode.
+# With -c drops the page cache before every run (needs root), to measure
+# reading from disk rather than from memory.
+#
+# Usage: ./bench_io.sh [-c] <character> <filename> [runs]
+
+MODES="mmap populate sequential hugepage read"
+
+COLD=0
+if [ "$1" == "-c" ]; then
+    COLD=1
+    shift
+fi
+TEST_CHAR=$1
+TEST_FILE=$2
+RUNS=${3:-5}
+
+if [ -z "$TEST_FILE" ]; then
+    echo "Usage: ./bench_io.sh [-c] <character> <filename> [runs]"
+    exit 1
+fi
+
+# best wall time in ms of RUNS runs of dispatcher with given flags
+best_time() {
+    BEST=""
+    for ((i=0; i<RUNS; i++)); do
+        if [ $COLD == 1 ]; then
+            sync
+            echo 3 > /proc/sys/vm/drop_caches
+        fi
+        START=$(date +%s%N)
+        ./dispatcher "$@" $TEST_CHAR $TEST_FILE > /dev/null
+        END=$(date +%s%N)
+        T=$(( (END - START) / 1000000 ))
+        if [ -z "$BEST" ] || [ $T -lt $BEST ]; then
+            BEST=$T
+        fi
+    done
+    echo $BEST
+}
+
+printf "%-12s %12s %12s\n" "mode" "processes" "threads"
+for MODE in $MODES; do
+    printf "%-12s %10sms %10sms\n" $MODE $(best_time -m $MODE) $(best_time -t -m $MODE)
+done
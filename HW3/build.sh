@@ -2,5 +2,5 @@
 
 rm counter
 rm dispatcher
-gcc -o dispatcher dispatcher.c
-gcc -o counter counter.c
+gcc -o dispatcher dispatcher.c count_engine.c count_io.c count_stream.c count_index.c count_trace.c -lpthread
+gcc -o counter counter.c count_engine.c count_io.c count_trace.c
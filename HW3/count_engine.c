@@ -0,0 +1,248 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+#include "count_engine.h"
+
+// byte counters of a vector overflow after 255 matches - flush them before
+// (each loop iteration adds at most 2 per byte)
+#define MAX_INNER_ITERATIONS 127
+// histogram kernel parameters - sub-histogram counters are 32 bit, so flush
+// them to the caller's histogram before any of them can overflow
+#define HISTOGRAM_BANKS 4
+#define HISTOGRAM_FLUSH_BYTES (1L << 30)
+// chunk checksum multiplier (64 bit FNV prime)
+#define CHECKSUM_PRIME 1099511628211ULL
+
+/*
+ * Scalar kernel - one byte per iteration
+ */
+static off_t countCharScalar(const char* arr, off_t length, char character) {
+	off_t count = 0;
+	for (off_t i=0; i<length; i++)
+		if (arr[i] == character)
+			count++;
+	return count;
+}
+
+#ifdef HAVE_X86_KERNELS
+/*
+ * AVX2 kernel - 64 bytes per iteration.
+ * Matches (0xFF) are subtracted from per-byte accumulators, which are
+ * summed horizontally with psadbw every MAX_INNER_ITERATIONS iterations.
+ */
+__attribute__((target("avx2")))
+static off_t countCharAVX2(const char* arr, off_t length, char character) {
+	const __m256i needle = _mm256_set1_epi8(character);
+	const __m256i zero = _mm256_setzero_si256();
+	off_t count = 0, i = 0;
+
+	while (length - i >= 64) {
+		__m256i acc = zero;
+		for (int j=0; j < MAX_INNER_ITERATIONS && length - i >= 64; j++, i += 64) {
+			__m256i v1 = _mm256_loadu_si256((const __m256i*) (arr + i));
+			__m256i v2 = _mm256_loadu_si256((const __m256i*) (arr + i + 32));
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v1, needle));
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v2, needle));
+		}
+		__m256i sums = _mm256_sad_epu8(acc, zero);
+		count += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+				_mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+	}
+	return count + countCharScalar(arr + i, length - i, character);
+}
+
+/*
+ * SSE2 kernel - 32 bytes per iteration, same accumulation as AVX2 kernel
+ */
+__attribute__((target("sse2")))
+static off_t countCharSSE2(const char* arr, off_t length, char character) {
+	const __m128i needle = _mm_set1_epi8(character);
+	const __m128i zero = _mm_setzero_si128();
+	off_t count = 0, i = 0;
+
+	while (length - i >= 32) {
+		__m128i acc = zero;
+		for (int j=0; j < MAX_INNER_ITERATIONS && length - i >= 32; j++, i += 32) {
+			__m128i v1 = _mm_loadu_si128((const __m128i*) (arr + i));
+			__m128i v2 = _mm_loadu_si128((const __m128i*) (arr + i + 16));
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v1, needle));
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v2, needle));
+		}
+		__m128i sums = _mm_sad_epu8(acc, zero);
+		count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+	}
+	return count + countCharScalar(arr + i, length - i, character);
+}
+#endif
+
+/*
+ * Counts number of occurrences of character in a buffer
+ */
+off_t countChar(const char* arr, off_t length, char character) {
+#ifdef HAVE_X86_KERNELS
+	if (__builtin_cpu_supports("avx2"))
+		return countCharAVX2(arr, length, character);
+	if (__builtin_cpu_supports("sse2"))
+		return countCharSSE2(arr, length, character);
+#endif
+	return countCharScalar(arr, length, character);
+}
+
+/*
+ * Histogram kernel - each of 4 consecutive bytes goes to its own sub-histogram
+ */
+static void countHistogramBanks(const unsigned char* arr, off_t length, uint32_t banks[][HISTOGRAM_SIZE]) {
+	off_t i = 0;
+	for (; length - i >= HISTOGRAM_BANKS; i += HISTOGRAM_BANKS) {
+		banks[0][arr[i]]++;
+		banks[1][arr[i+1]]++;
+		banks[2][arr[i+2]]++;
+		banks[3][arr[i+3]]++;
+	}
+	for (; i < length; i++)
+		banks[0][arr[i]]++;
+}
+
+/*
+ * Adds number of occurrences of every byte value in a buffer to histogram
+ */
+void countHistogram(const char* arr, off_t length, off_t* histogram) {
+	uint32_t banks[HISTOGRAM_BANKS][HISTOGRAM_SIZE];
+	for (off_t offset = 0; offset < length; offset += HISTOGRAM_FLUSH_BYTES) {
+		off_t segment = length - offset;
+		if (segment > HISTOGRAM_FLUSH_BYTES) segment = HISTOGRAM_FLUSH_BYTES;
+
+		memset(banks, 0, sizeof(banks));
+		countHistogramBanks((const unsigned char*) arr + offset, segment, banks);
+		for (int c=0; c < HISTOGRAM_SIZE; c++)
+			for (int b=0; b < HISTOGRAM_BANKS; b++)
+				histogram[c] += banks[b][c];
+	}
+}
+
+/*
+ * Continues checksum of a chunk - FNV style over 8 byte words, with the high
+ * bits folded back down so a change anywhere in a word reaches every bit
+ */
+unsigned long long checksumBuffer(unsigned long long checksum, const char* arr, off_t length) {
+	off_t i = 0;
+	for (; length - i >= 8; i += 8) {
+		uint64_t word;
+		memcpy(&word, arr + i, 8);
+		checksum = (checksum ^ word) * CHECKSUM_PRIME;
+		checksum ^= checksum >> 29;
+	}
+	for (; i < length; i++) {
+		checksum = (checksum ^ (unsigned char) arr[i]) * CHECKSUM_PRIME;
+		checksum ^= checksum >> 29;
+	}
+	return checksum;
+}
+
+/*
+ * Scalar substring kernel - checks first and last byte before comparing
+ */
+static off_t countSubstringScalar(const char* arr, off_t start, off_t numPositions,
+		const char* pattern, int patternLength) {
+	off_t count = 0;
+	char first = pattern[0], last = pattern[patternLength-1];
+	for (off_t i=start; i<numPositions; i++)
+		if (arr[i] == first && arr[i+patternLength-1] == last &&
+				memcmp(arr + i + 1, pattern + 1, patternLength - 2) == 0)
+			count++;
+	return count;
+}
+
+#ifdef HAVE_X86_KERNELS
+/*
+ * AVX2 substring kernel - 32 candidate positions per iteration.
+ * Positions matching both first and last pattern byte are verified.
+ */
+__attribute__((target("avx2")))
+static off_t countSubstringAVX2(const char* arr, off_t numPositions, const char* pattern, int patternLength) {
+	const __m256i first = _mm256_set1_epi8(pattern[0]);
+	const __m256i last = _mm256_set1_epi8(pattern[patternLength-1]);
+	off_t count = 0, i = 0;
+
+	for (; numPositions - i >= 32; i += 32) {
+		__m256i firstBlock = _mm256_loadu_si256((const __m256i*) (arr + i));
+		__m256i lastBlock = _mm256_loadu_si256((const __m256i*) (arr + i + patternLength - 1));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(
+				_mm256_cmpeq_epi8(firstBlock, first), _mm256_cmpeq_epi8(lastBlock, last)));
+		while (mask) {
+			int bit = __builtin_ctz(mask);
+			if (memcmp(arr + i + bit + 1, pattern + 1, patternLength - 2) == 0)
+				count++;
+			mask &= mask - 1;
+		}
+	}
+	return count + countSubstringScalar(arr, i, numPositions, pattern, patternLength);
+}
+
+/*
+ * SSE2 substring kernel - 16 candidate positions per iteration
+ */
+__attribute__((target("sse2")))
+static off_t countSubstringSSE2(const char* arr, off_t numPositions, const char* pattern, int patternLength) {
+	const __m128i first = _mm_set1_epi8(pattern[0]);
+	const __m128i last = _mm_set1_epi8(pattern[patternLength-1]);
+	off_t count = 0, i = 0;
+
+	for (; numPositions - i >= 16; i += 16) {
+		__m128i firstBlock = _mm_loadu_si128((const __m128i*) (arr + i));
+		__m128i lastBlock = _mm_loadu_si128((const __m128i*) (arr + i + patternLength - 1));
+		uint32_t mask = _mm_movemask_epi8(_mm_and_si128(
+				_mm_cmpeq_epi8(firstBlock, first), _mm_cmpeq_epi8(lastBlock, last)));
+		while (mask) {
+			int bit = __builtin_ctz(mask);
+			if (memcmp(arr + i + bit + 1, pattern + 1, patternLength - 2) == 0)
+				count++;
+			mask &= mask - 1;
+		}
+	}
+	return count + countSubstringScalar(arr, i, numPositions, pattern, patternLength);
+}
+#endif
+
+/*
+ * Counts occurrences of pattern starting in a buffer
+ */
+off_t countSubstring(const char* arr, off_t length, off_t available, const char* pattern, int patternLength) {
+	if (patternLength == 1)
+		return countChar(arr, length, pattern[0]);
+
+	// positions where a whole pattern fits
+	off_t numPositions = available - patternLength + 1;
+	if (numPositions > length) numPositions = length;
+	if (numPositions <= 0)
+		return 0;
+
+#ifdef HAVE_X86_KERNELS
+	if (__builtin_cpu_supports("avx2"))
+		return countSubstringAVX2(arr, numPositions, pattern, patternLength);
+	if (__builtin_cpu_supports("sse2"))
+		return countSubstringSSE2(arr, numPositions, pattern, patternLength);
+#endif
+	return countSubstringScalar(arr, 0, numPositions, pattern, patternLength);
+}
+
+/*
+ * Counts target in a buffer
+ */
+off_t countTargetInBuffer(const char* arr, off_t length, off_t available, countTarget* target) {
+	if (target->pattern != NULL)
+		return countSubstring(arr, length, available, target->pattern, target->patternLength);
+	if (target->histogram != NULL) {
+		countHistogram(arr, length, target->histogram);
+		if (target->checksum != NULL)
+			*target->checksum = checksumBuffer(*target->checksum, arr, length);
+		return 0;
+	}
+	return countChar(arr, length, target->character);
+}
@@ -0,0 +1,63 @@
+#ifndef COUNT_ENGINE_H_
+#define COUNT_ENGINE_H_
+
+#include <sys/types.h>
+
+// number of distinct byte values
+#define HISTOGRAM_SIZE 256
+// longest substring to count - chunks are read this much past their end
+#define MAX_PATTERN_LENGTH 4096
+// initial value of a chunk checksum (see checksumBuffer)
+#define CHECKSUM_SEED 14695981039346656037ULL
+
+// what to count in a buffer - a character, a substring or all byte values
+typedef struct count_target {
+	char character;
+	const char* pattern; // substring mode if not NULL
+	int patternLength;
+	off_t* histogram; // histogram mode if not NULL - accumulated (not reset)
+	unsigned long long* checksum; // histogram mode - if not NULL, counted bytes are hashed into it
+} countTarget;
+
+/*
+ * Counts number of occurrences of character in a buffer.
+ * Uses an AVX2 or SSE2 kernel (chosen at runtime by CPU support) that
+ * compares 64 / 32 bytes at a time, with a scalar loop for the tail.
+ */
+off_t countChar(const char* arr, off_t length, char character);
+
+/*
+ * Adds number of occurrences of every byte value in a buffer to histogram.
+ * Counts into several interleaved sub-histograms (so consecutive equal bytes
+ * do not stall on the same counter) which are merged at the end.
+ * @param histogram - array of HISTOGRAM_SIZE counters, accumulated (not reset)
+ */
+void countHistogram(const char* arr, off_t length, off_t* histogram);
+
+/*
+ * Continues the checksum of a chunk with its next bytes. Hashes 8 bytes at a
+ * time, so a chunk checksummed in parts gives the same result only if every
+ * part but the last is a multiple of 8 bytes long.
+ * @param checksum - checksum of preceding parts, CHECKSUM_SEED for the first
+ * @return checksum including this part
+ */
+unsigned long long checksumBuffer(unsigned long long checksum, const char* arr, off_t length);
+
+/*
+ * Counts (possibly overlapping) occurrences of pattern starting in the first
+ * length bytes of a buffer. Occurrences may extend past length, up to
+ * available bytes - so adjacent chunks of a file count every occurrence once.
+ * Uses an AVX2 or SSE2 filter comparing the first and last pattern bytes at
+ * 32 / 16 positions at a time, verifying candidates with memcmp.
+ * @param available - valid bytes in buffer, at least length
+ */
+off_t countSubstring(const char* arr, off_t length, off_t available, const char* pattern, int patternLength);
+
+/*
+ * Counts target in the first length bytes of a buffer with available valid
+ * bytes (see countSubstring)
+ * @return number of occurrences, 0 in histogram mode
+ */
+off_t countTargetInBuffer(const char* arr, off_t length, off_t available, countTarget* target);
+
+#endif /* COUNT_ENGINE_H_ */
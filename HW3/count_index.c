@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "count_index.h"
+
+#define STR_LEN 1025
+// read size for checking chunks - a multiple of 8 (see checksumBuffer)
+#define CHECK_BUFFER_SIZE (256*1024)
+
+// output messages
+#define INDEX_OPEN_ERROR "Error opening count index: %s\n"
+#define INDEX_WRITE_ERROR "Error writing count index: %s\n"
+#define INDEX_STALE_MSG "Count index of %s does not match file, recounting\n"
+
+// index file header - identifies the indexed version of the file
+typedef struct index_header {
+	unsigned magic;
+	unsigned version;
+	dev_t device;
+	ino_t inode;
+	off_t fileSize;
+	time_t mtimeSec;
+	long mtimeNsec;
+	off_t chunkSize;
+	int numChunks;
+} indexHeader;
+
+/*
+ * Checksum of a chunk of an open file, 0 if it can not be read whole
+ */
+static unsigned long long chunkChecksum(int fd, off_t offset, off_t length, char* buffer) {
+	unsigned long long checksum = CHECKSUM_SEED;
+	while (length > 0) {
+		off_t toRead = length < CHECK_BUFFER_SIZE ? length : CHECK_BUFFER_SIZE;
+		ssize_t bytesRead = pread(fd, buffer, toRead, offset);
+		if (bytesRead == -1 && errno == EINTR)
+			continue;
+		if (bytesRead != toRead)
+			return 0;
+		checksum = checksumBuffer(checksum, buffer, bytesRead);
+		offset += bytesRead;
+		length -= bytesRead;
+	}
+	return checksum;
+}
+
+/*
+ * Takes stamp of an open file
+ */
+static int fileStamp(int fd, indexStamp* stamp) {
+	struct stat st;
+	memset(stamp, 0, sizeof(indexStamp));
+	if (fstat(fd, &st) == -1)
+		return -1;
+	stamp->device = st.st_dev;
+	stamp->inode = st.st_ino;
+	stamp->fileSize = st.st_size;
+	stamp->mtimeSec = st.st_mtim.tv_sec;
+	stamp->mtimeNsec = st.st_mtim.tv_nsec;
+	return 0;
+}
+
+/*
+ * Fills index header of a file with given stamp
+ */
+static void stampHeader(const indexStamp* stamp, int numChunks, indexHeader* header) {
+	memset(header, 0, sizeof(indexHeader));
+	header->magic = INDEX_MAGIC;
+	header->version = INDEX_VERSION;
+	header->device = stamp->device;
+	header->inode = stamp->inode;
+	header->fileSize = stamp->fileSize;
+	header->mtimeSec = stamp->mtimeSec;
+	header->mtimeNsec = stamp->mtimeNsec;
+	header->chunkSize = INDEX_CHUNK_SIZE;
+	header->numChunks = numChunks;
+}
+
+/*
+ * Loads the index of a file and marks valid chunks
+ */
+int loadCountIndex(const char* filename, int numChunks, indexChunk* chunks, char* valid, indexStamp* stamp) {
+	memset(valid, 0, numChunks);
+
+	// stamp file before any of it is counted
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		memset(stamp, 0, sizeof(indexStamp));
+		return -1;
+	}
+	if (fileStamp(fd, stamp) == -1) {
+		close(fd);
+		return -1;
+	}
+	char indexName[STR_LEN];
+	snprintf(indexName, STR_LEN, "%s%s", filename, INDEX_SUFFIX);
+	int indexFd = open(indexName, O_RDONLY);
+	if (indexFd == -1) { // no index yet
+		close(fd);
+		return errno == ENOENT ? 0 : -1;
+	}
+
+	// compare indexed and current file
+	indexHeader header, current;
+	int numValid = 0;
+	stampHeader(stamp, numChunks, &current);
+	if (read(indexFd, &header, sizeof(header)) != sizeof(header) ||
+			header.magic != INDEX_MAGIC || header.version != INDEX_VERSION ||
+			header.device != current.device || header.inode != current.inode ||
+			header.chunkSize != current.chunkSize || header.fileSize > current.fileSize ||
+			header.numChunks > numChunks) {
+		printf(INDEX_STALE_MSG, filename);
+		goto CLEANUP;
+	}
+	int unchanged = (header.fileSize == current.fileSize && header.mtimeSec == current.mtimeSec &&
+			header.mtimeNsec == current.mtimeNsec);
+	// a grown file is taken as appended to - only its last complete indexed
+	// chunk is checked, in case its end was rewritten along with the append.
+	// A file of the same size was edited in place - all chunks are checked.
+	int grown = (header.fileSize < current.fileSize);
+	int lastComplete = header.fileSize / INDEX_CHUNK_SIZE - 1;
+	char* buffer = NULL;
+	if (!unchanged && (buffer = (char*) malloc(CHECK_BUFFER_SIZE)) == NULL)
+		goto CLEANUP;
+
+	// read chunks - a changed file keeps complete chunks whose bytes did not change
+	for (int i=0; i < header.numChunks; i++) {
+		if (read(indexFd, &chunks[i], sizeof(indexChunk)) != sizeof(indexChunk)) {
+			memset(&chunks[i], 0, sizeof(indexChunk));
+			break;
+		}
+		off_t offset = (off_t) i * INDEX_CHUNK_SIZE;
+		int check = !unchanged && (!grown || i == lastComplete);
+		if (!unchanged && (offset + INDEX_CHUNK_SIZE > header.fileSize || (check &&
+				chunkChecksum(fd, offset, INDEX_CHUNK_SIZE, buffer) != chunks[i].checksum))) {
+			memset(&chunks[i], 0, sizeof(indexChunk)); // to be counted again
+			continue;
+		}
+		valid[i] = 1;
+		numValid++;
+	}
+	free(buffer);
+
+	CLEANUP:
+	close(fd);
+	close(indexFd);
+	return numValid;
+}
+
+/*
+ * Saves the index of a file
+ */
+int saveCountIndex(const char* filename, const indexStamp* stamp, off_t fileSize, int numChunks, indexChunk* chunks) {
+	indexHeader header;
+	stampHeader(stamp, numChunks, &header);
+	// file changed before it was stamped - index only counted part, never as unchanged
+	if (header.fileSize != fileSize) {
+		header.fileSize = fileSize;
+		header.mtimeSec = header.mtimeNsec = 0;
+	}
+
+	// write to temporary file and replace old index - never leaves a partial index
+	char indexName[STR_LEN], tempName[STR_LEN];
+	snprintf(indexName, STR_LEN, "%s%s", filename, INDEX_SUFFIX);
+	snprintf(tempName, STR_LEN, "%s%s.tmp", filename, INDEX_SUFFIX);
+	int indexFd = open(tempName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (indexFd == -1) {
+		printf(INDEX_OPEN_ERROR, strerror(errno));
+		return -1;
+	}
+	size_t chunksSize = numChunks * sizeof(indexChunk);
+	if (write(indexFd, &header, sizeof(header)) != sizeof(header) ||
+			write(indexFd, chunks, chunksSize) != chunksSize) {
+		printf(INDEX_WRITE_ERROR, strerror(errno));
+		close(indexFd);
+		unlink(tempName);
+		return -1;
+	}
+	close(indexFd);
+	if (rename(tempName, indexName) == -1) {
+		printf(INDEX_WRITE_ERROR, strerror(errno));
+		unlink(tempName);
+		return -1;
+	}
+	return 0;
+}
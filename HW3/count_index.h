@@ -0,0 +1,56 @@
+#ifndef COUNT_INDEX_H_
+#define COUNT_INDEX_H_
+
+#include <sys/types.h>
+
+#include "count_engine.h"
+
+// sidecar index of per-chunk counts, kept next to the counted file
+#define INDEX_SUFFIX ".cidx"
+#define INDEX_MAGIC 0x58444943 // "CIDX"
+#define INDEX_VERSION 2
+// chunk size of indexed files - fixed, so chunks of a grown file line up
+// with the chunks of its index
+#define INDEX_CHUNK_SIZE (4*1024*1024)
+
+// counts of a chunk of an indexed file
+typedef struct index_chunk {
+	unsigned long long checksum; // of all its bytes, computed while counting (see checksumBuffer)
+	off_t histogram[HISTOGRAM_SIZE];
+} indexChunk;
+
+// version of an indexed file - taken before counting and saved with its
+// counts, so a change made while counting is noticed on the next load
+typedef struct index_stamp {
+	dev_t device;
+	ino_t inode;
+	off_t fileSize;
+	time_t mtimeSec;
+	long mtimeNsec;
+} indexStamp;
+
+/*
+ * Loads the index of a file into chunks and marks chunks whose counts are
+ * still valid in valid[]. An index of an unchanged file (same size and
+ * mtime) is valid as a whole. A grown file is taken as appended to - its
+ * complete indexed chunks are valid without reading them, except the last
+ * one, which is valid only if its checksum did not change. A file of the same
+ * size but another mtime was edited in place - each complete indexed chunk
+ * is read and valid only if its checksum did not change.
+ * A missing or mismatching (other inode, truncated file) index marks no chunk.
+ * @param chunks, valid - numChunks entries, for chunks of INDEX_CHUNK_SIZE
+ * @param stamp - set to the current version of the file, to be saved with its counts
+ * @return number of valid chunks, -1 on failure
+ */
+int loadCountIndex(const char* filename, int numChunks, indexChunk* chunks, char* valid, indexStamp* stamp);
+
+/*
+ * Saves the index of a file - every chunk holds its histogram and checksum,
+ * either loaded or computed while counting.
+ * @param stamp - version of the file taken by loadCountIndex, before counting
+ * @param fileSize - size of the file that was counted
+ * @return 0 on success, -1 on failure
+ */
+int saveCountIndex(const char* filename, const indexStamp* stamp, off_t fileSize, int numChunks, indexChunk* chunks);
+
+#endif /* COUNT_INDEX_H_ */
@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include "count_engine.h"
+#include "count_io.h"
+#include "count_trace.h"
+
+/*
+ * Parses io mode name
+ */
+int parseIOMode(const char* name) {
+	const char* names[] = IO_MODE_NAMES;
+	for (int i=0; i < NUM_IO_MODES; i++)
+		if (strcmp(name, names[i]) == 0)
+			return i;
+	return -1;
+}
+
+/*
+ * Maps a range of an open file with io mode flags and advice
+ */
+char* mapFileRange(int fd, off_t offset, off_t length, int ioMode) {
+	int flags = MAP_PRIVATE;
+	if (ioMode == IO_POPULATE)
+		flags |= MAP_POPULATE;
+
+	char* arr = (char*) mmap(NULL, length, PROT_READ, flags, fd, offset);
+	if (arr == MAP_FAILED)
+		return arr;
+
+	// advice is only a hint - ignore failures (e.g. no huge page support)
+	if (ioMode == IO_SEQUENTIAL)
+		madvise(arr, length, MADV_SEQUENTIAL | MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+	else if (ioMode == IO_HUGEPAGE)
+		madvise(arr, length, MADV_HUGEPAGE);
+#endif
+	return arr;
+}
+
+/*
+ * Bytes needed past a range to count target - a substring may start at the
+ * last byte of the range
+ */
+static off_t targetOverlap(countTarget* target, off_t length, off_t available) {
+	off_t overlap = (target->pattern != NULL) ? target->patternLength - 1 : 0;
+	return (length + overlap > available) ? available - length : overlap;
+}
+
+/*
+ * Counts a range of an open file read into a reused buffer - each read
+ * overlaps the next by the target's overlap
+ */
+static off_t countFileRangeRead(int fd, off_t offset, off_t length, off_t available,
+		countTarget* target, char* buffer, long* mappedAt) {
+	off_t counter = 0;
+	while (length > 0) {
+		off_t piece = READ_BUFFER_SIZE - (target->pattern != NULL ? target->patternLength - 1 : 0);
+		if (piece > length) piece = length;
+		off_t toRead = piece + targetOverlap(target, piece, available);
+		ssize_t bytesRead = pread(fd, buffer, toRead, offset);
+		if (bytesRead == -1 && errno == EINTR)
+			continue;
+		if (bytesRead < toRead) { // error or file truncated under us
+			if (bytesRead >= 0) errno = EIO;
+			return -1;
+		}
+		if (mappedAt != NULL && *mappedAt == 0)
+			*mappedAt = traceNow();
+		counter += countTargetInBuffer(buffer, piece, bytesRead, target);
+		offset += piece;
+		length -= piece;
+		available -= piece;
+	}
+	return counter;
+}
+
+/*
+ * Counts a range of an open file with given io mode
+ */
+off_t countFileRange(int fd, off_t offset, off_t length, off_t available,
+		countTarget* target, int ioMode, char* buffer, long* mappedAt) {
+	if (mappedAt != NULL)
+		*mappedAt = 0;
+	if (length == 0)
+		return 0;
+	if (ioMode == IO_READ)
+		return countFileRangeRead(fd, offset, length, available, target, buffer, mappedAt);
+
+	off_t mapLength = length + targetOverlap(target, length, available);
+	char* arr = mapFileRange(fd, offset, mapLength, ioMode);
+	if (arr == MAP_FAILED)
+		return -1;
+	if (mappedAt != NULL)
+		*mappedAt = traceNow();
+	off_t counter = countTargetInBuffer(arr, length, mapLength, target);
+	munmap(arr, mapLength);
+	return counter;
+}
@@ -0,0 +1,49 @@
+#ifndef COUNT_IO_H_
+#define COUNT_IO_H_
+
+#include <sys/types.h>
+
+#include "count_engine.h"
+
+// ways of bringing a chunk of a file into memory
+#define IO_MMAP 0 // plain private mapping, page fault per page
+#define IO_POPULATE 1 // mapping pre-faulted with MAP_POPULATE
+#define IO_SEQUENTIAL 2 // mapping with MADV_SEQUENTIAL | MADV_WILLNEED read-ahead
+#define IO_HUGEPAGE 3 // mapping with MADV_HUGEPAGE (used where the filesystem supports it)
+#define IO_READ 4 // read() into a reused buffer, no mapping
+#define NUM_IO_MODES 5
+#define IO_MODE_NAMES {"mmap", "populate", "sequential", "hugepage", "read"}
+#define IO_MODE_LIST "mmap|populate|sequential|hugepage|read"
+
+// buffer size for IO_READ - large enough to amortize the syscall,
+// small enough to stay in L2 between read and count, a multiple of 8 so
+// chunk checksums are the same as when counting a mapped chunk
+#define READ_BUFFER_SIZE (256*1024)
+
+/*
+ * Parses io mode name.
+ * @return io mode id, -1 if name is not a known mode
+ */
+int parseIOMode(const char* name);
+
+/*
+ * Maps length bytes of an open file starting at offset (page aligned),
+ * applying the flags and advice of a mapping io mode (any mode but IO_READ).
+ * @return mapped address, MAP_FAILED on failure (errno set)
+ */
+char* mapFileRange(int fd, off_t offset, off_t length, int ioMode);
+
+/*
+ * Counts target in length bytes of an open file starting at offset (page
+ * aligned), bringing them into memory with given io mode. For a substring
+ * target up to patternLength-1 bytes after the range are read as well.
+ * @param available - bytes in file from offset on, at least length
+ * @param buffer - READ_BUFFER_SIZE bytes used by IO_READ, may be reused between calls
+ * @param mappedAt - if not NULL, set to traceNow() time the range was mapped
+ *                   (or its first part read)
+ * @return number of occurrences (0 in histogram mode), -1 on failure (errno set)
+ */
+off_t countFileRange(int fd, off_t offset, off_t length, off_t available,
+		countTarget* target, int ioMode, char* buffer, long* mappedAt);
+
+#endif /* COUNT_IO_H_ */
@@ -0,0 +1,28 @@
+#ifndef COUNT_PROTOCOL_H_
+#define COUNT_PROTOCOL_H_
+
+#include <sys/types.h>
+
+// task record read by a counter process from the dispatcher's work pipe - a
+// chunk of the file to count. Same atomicity as counterResult, so each read
+// of a record by one of the competing counters gets a whole record.
+typedef struct counter_task {
+	int counterID;
+	off_t offset;
+	off_t length;
+} counterTask;
+
+// result record written by a counter process to the dispatcher's result pipe.
+// Small enough (< PIPE_BUF) for the write to be atomic, so records of
+// concurrent counters never interleave.
+typedef struct counter_result {
+	int counterID;
+	int pid;
+	off_t count;
+	// timestamps for dispatcher tracing (see count_trace.h)
+	long started; // counter process started
+	long mapped; // chunk in memory
+	long scanned; // chunk counted
+} counterResult;
+
+#endif /* COUNT_PROTOCOL_H_ */
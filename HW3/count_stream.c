@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "count_engine.h"
+#include "count_stream.h"
+
+// output messages
+#define STREAM_ALLOC_ERROR "Error allocating stream buffers\n"
+#define STREAM_READ_ERROR "Error reading input stream: %s\n"
+#define STREAM_THREAD_ERROR "Error creating stream counting thread\n"
+
+// bounded queue of buffers - free buffers wait for the reader, full buffers
+// wait for the counting threads. Both are rings of buffer ids.
+typedef struct stream_queue {
+	char character;
+	int numBuffers;
+	char** buffers;
+	ssize_t* lengths;
+	int* freeRing; // ids of buffers ready to be read into
+	int freeHead, numFree;
+	int* fullRing; // ids of buffers ready to be counted, in input order
+	int fullHead, numFull;
+	int eof; // no more buffers will be queued
+	off_t count; // merged results of all threads
+	off_t* histogram;
+	pthread_mutex_t lock;
+	pthread_cond_t hasFree;
+	pthread_cond_t hasFull;
+} streamQueue;
+
+/*
+ * Counting thread - takes full buffers until the queue is empty and closed,
+ * counts them into private results and returns each buffer to the reader.
+ * Private results are merged into the queue once, when the thread is done.
+ */
+static void* streamThread(void* queuePtr) {
+	streamQueue* queue = (streamQueue*) queuePtr;
+	off_t count = 0, histogram[HISTOGRAM_SIZE] = {0};
+
+	while (1) {
+		// take next full buffer
+		pthread_mutex_lock(&(queue->lock));
+		while (queue->numFull == 0 && !queue->eof)
+			pthread_cond_wait(&(queue->hasFull), &(queue->lock));
+		if (queue->numFull == 0) { // closed and empty
+			pthread_mutex_unlock(&(queue->lock));
+			break;
+		}
+		int id = queue->fullRing[queue->fullHead];
+		queue->fullHead = (queue->fullHead + 1) % queue->numBuffers;
+		queue->numFull--;
+		pthread_mutex_unlock(&(queue->lock));
+
+		// count
+		if (queue->histogram != NULL)
+			countHistogram(queue->buffers[id], queue->lengths[id], histogram);
+		else
+			count += countChar(queue->buffers[id], queue->lengths[id], queue->character);
+
+		// return buffer to reader
+		pthread_mutex_lock(&(queue->lock));
+		queue->freeRing[(queue->freeHead + queue->numFree) % queue->numBuffers] = id;
+		queue->numFree++;
+		pthread_cond_signal(&(queue->hasFree));
+		pthread_mutex_unlock(&(queue->lock));
+	}
+
+	// merge results
+	pthread_mutex_lock(&(queue->lock));
+	queue->count += count;
+	if (queue->histogram != NULL)
+		for (int c=0; c < HISTOGRAM_SIZE; c++)
+			queue->histogram[c] += histogram[c];
+	pthread_mutex_unlock(&(queue->lock));
+	return NULL;
+}
+
+/*
+ * Reads a chunk of up to length bytes - less only at end of input
+ * returns number of bytes read, -1 on failure
+ */
+static ssize_t readChunk(int fd, char* buffer, size_t length) {
+	size_t total = 0;
+	while (total < length) {
+		ssize_t bytesRead = read(fd, buffer + total, length - total);
+		if (bytesRead == -1 && errno == EINTR)
+			continue;
+		if (bytesRead == -1)
+			return -1;
+		if (bytesRead == 0)
+			break;
+		total += bytesRead;
+	}
+	return total;
+}
+
+/*
+ * Reads input into free buffers and queues them for counting until end of
+ * input (or a read error), then closes the queue
+ * returns 0 on success, -1 on failure
+ */
+static int readStream(int fd, streamQueue* queue) {
+	int res = 0;
+	while (1) {
+		// take a free buffer - blocks while all buffers are queued or counted
+		pthread_mutex_lock(&(queue->lock));
+		while (queue->numFree == 0)
+			pthread_cond_wait(&(queue->hasFree), &(queue->lock));
+		int id = queue->freeRing[queue->freeHead];
+		queue->freeHead = (queue->freeHead + 1) % queue->numBuffers;
+		queue->numFree--;
+		pthread_mutex_unlock(&(queue->lock));
+
+		ssize_t length = readChunk(fd, queue->buffers[id], STREAM_CHUNK_SIZE);
+		if (length == -1) {
+			printf(STREAM_READ_ERROR, strerror(errno));
+			res = -1;
+		}
+
+		// queue buffer (or return empty one) and close queue at end of input
+		pthread_mutex_lock(&(queue->lock));
+		if (length > 0) {
+			queue->lengths[id] = length;
+			queue->fullRing[(queue->fullHead + queue->numFull) % queue->numBuffers] = id;
+			queue->numFull++;
+			pthread_cond_signal(&(queue->hasFull));
+		}
+		else {
+			queue->freeRing[(queue->freeHead + queue->numFree) % queue->numBuffers] = id;
+			queue->numFree++;
+		}
+		if (length < STREAM_CHUNK_SIZE) {
+			queue->eof = 1;
+			pthread_cond_broadcast(&(queue->hasFull));
+		}
+		pthread_mutex_unlock(&(queue->lock));
+
+		if (length < STREAM_CHUNK_SIZE)
+			return res;
+	}
+}
+
+/*
+ * Frees queue buffers and rings
+ */
+static void freeQueue(streamQueue* queue) {
+	if (queue->buffers != NULL)
+		for (int i=0; i < queue->numBuffers; i++)
+			free(queue->buffers[i]);
+	free(queue->buffers);
+	free(queue->lengths);
+	free(queue->freeRing);
+	free(queue->fullRing);
+}
+
+/*
+ * Counts occurrences of character in a non-seekable input
+ */
+int countStream(int fd, char character, int numThreads, off_t* count, off_t* histogram) {
+	streamQueue queue = {character, STREAM_BUFFERS_PER_THREAD * numThreads + 1,
+			NULL, NULL, NULL, 0, 0, NULL, 0, 0, 0, 0, histogram,
+			PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+	// allocate buffers - all free
+	queue.buffers = (char**) calloc(queue.numBuffers, sizeof(char*));
+	queue.lengths = (ssize_t*) malloc(queue.numBuffers * sizeof(ssize_t));
+	queue.freeRing = (int*) malloc(queue.numBuffers * sizeof(int));
+	queue.fullRing = (int*) malloc(queue.numBuffers * sizeof(int));
+	if (queue.buffers == NULL || queue.lengths == NULL || queue.freeRing == NULL || queue.fullRing == NULL) {
+		printf(STREAM_ALLOC_ERROR);
+		freeQueue(&queue);
+		return -1;
+	}
+	for (int i=0; i < queue.numBuffers; i++) {
+		if ((queue.buffers[i] = (char*) malloc(STREAM_CHUNK_SIZE)) == NULL) {
+			printf(STREAM_ALLOC_ERROR);
+			freeQueue(&queue);
+			return -1;
+		}
+		queue.freeRing[i] = i;
+	}
+	queue.numFree = queue.numBuffers;
+
+	// run counting threads - at least one is needed, calling thread reads
+	pthread_t* threads = (pthread_t*) malloc(numThreads * sizeof(pthread_t));
+	if (threads == NULL) {
+		printf(STREAM_ALLOC_ERROR);
+		freeQueue(&queue);
+		return -1;
+	}
+	int numStarted = 0;
+	for (; numStarted < numThreads; numStarted++) {
+		if (pthread_create(&threads[numStarted], NULL, streamThread, &queue)) {
+			printf(STREAM_THREAD_ERROR);
+			break;
+		}
+	}
+	if (numStarted == 0) {
+		free(threads);
+		freeQueue(&queue);
+		return -1;
+	}
+
+	int res = readStream(fd, &queue);
+	for (int i=0; i < numStarted; i++)
+		pthread_join(threads[i], NULL);
+
+	*count = queue.count;
+	free(threads);
+	freeQueue(&queue);
+	return res;
+}
@@ -0,0 +1,21 @@
+#ifndef COUNT_STREAM_H_
+#define COUNT_STREAM_H_
+
+#include <sys/types.h>
+
+// streaming parameters - buffers in flight are bounded by the queue size,
+// so memory use does not depend on the (unknown) length of the input
+#define STREAM_CHUNK_SIZE (1024*1024)
+#define STREAM_BUFFERS_PER_THREAD 2
+
+/*
+ * Counts occurrences of character in a non-seekable input (pipe, stdin).
+ * The calling thread reads STREAM_CHUNK_SIZE chunks into a bounded pool of
+ * buffers and numThreads worker threads count them as they arrive.
+ * @param count - set to number of occurrences (untouched in histogram mode)
+ * @param histogram - if not NULL, adds counts of all byte values to it instead
+ * @return 0 on success, -1 on failure
+ */
+int countStream(int fd, char character, int numThreads, off_t* count, off_t* histogram);
+
+#endif /* COUNT_STREAM_H_ */
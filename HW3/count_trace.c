@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "count_trace.h"
+
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_USEC 1000L
+
+// output messages
+#define TRACE_OPEN_ERROR "Error opening trace file: %s\n"
+#define TRACE_HEADER_MSG "Trace: %d chunks, %.3f ms\n"
+#define TRACE_STEP_MSG "  %-20s avg %10.1f us   max %10.1f us   (%d)\n"
+#define TRACE_EVENT_JSON "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"chunk\":%d}}"
+
+/*
+ * Current monotonic time in nanoseconds
+ */
+long traceNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+// duration statistics of one step
+typedef struct step_stats {
+	const char* name;
+	double total;
+	double max;
+	int num;
+} stepStats;
+
+/*
+ * Adds duration between two timestamps to step statistics, if both happened
+ */
+static void addStep(stepStats* step, long from, long to) {
+	if (from == 0 || to == 0)
+		return;
+	double duration = (double) (to - from) / NSEC_PER_USEC;
+	step->total += duration;
+	if (duration > step->max) step->max = duration;
+	step->num++;
+}
+
+/*
+ * Prints a summary of where time went
+ */
+void printTraceSummary(traceEvent* events, int numEvents, traceSpawn* spawns, int numSpawns, long start) {
+	stepStats steps[] = {{"spawn -> start", 0, 0, 0}, {"dispatch -> mapped", 0, 0, 0},
+			{"mapped -> scanned", 0, 0, 0}, {"scanned -> received", 0, 0, 0}};
+	for (int i=0; i<numSpawns; i++)
+		addStep(&steps[0], spawns[i].forked, spawns[i].started);
+	for (int i=0; i<numEvents; i++) {
+		addStep(&steps[1], events[i].dispatched, events[i].mapped);
+		addStep(&steps[2], events[i].mapped, events[i].scanned);
+		addStep(&steps[3], events[i].scanned, events[i].received);
+	}
+
+	printf(TRACE_HEADER_MSG, numEvents, (double) (traceNow() - start) / (NSEC_PER_SEC / 1000));
+	for (int i=0; i < sizeof(steps) / sizeof(stepStats); i++)
+		if (steps[i].num > 0)
+			printf(TRACE_STEP_MSG, steps[i].name, steps[i].total / steps[i].num, steps[i].max, steps[i].num);
+}
+
+/*
+ * Writes a complete ("X") event if both timestamps happened
+ */
+static void writeSpan(FILE* file, int* first, const char* name, const char* category,
+		long from, long to, long start, int tid, int chunk) {
+	if (from == 0 || to == 0)
+		return;
+	fprintf(file, TRACE_EVENT_JSON, *first ? "\n" : ",\n", name, category,
+			(double) (from - start) / NSEC_PER_USEC, (double) (to - from) / NSEC_PER_USEC, tid, chunk);
+	*first = 0;
+}
+
+/*
+ * Writes events as a Chrome trace-event JSON file
+ */
+int writeTrace(const char* path, traceEvent* events, int numEvents, traceSpawn* spawns, int numSpawns, long start) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		printf(TRACE_OPEN_ERROR, strerror(errno));
+		return -1;
+	}
+
+	int first = 1;
+	fprintf(file, "{\"traceEvents\":[");
+	for (int i=0; i<numSpawns; i++)
+		writeSpan(file, &first, "spawn", "counter", spawns[i].forked, spawns[i].started, start, spawns[i].pid, -1);
+	for (int i=0; i<numEvents; i++) {
+		writeSpan(file, &first, "map", "chunk", events[i].dispatched, events[i].mapped, start, events[i].worker, i);
+		writeSpan(file, &first, "scan", "chunk", events[i].mapped, events[i].scanned, start, events[i].worker, i);
+		writeSpan(file, &first, "deliver", "chunk", events[i].scanned, events[i].received, start, events[i].worker, i);
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	if (fclose(file) == EOF) {
+		printf(TRACE_OPEN_ERROR, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef COUNT_TRACE_H_
+#define COUNT_TRACE_H_
+
+#include <sys/types.h>
+
+// timestamps of a chunk, in nanoseconds of the monotonic clock (shared by
+// all processes), 0 for a step that did not happen
+typedef struct trace_event {
+	long dispatched; // handed to a worker
+	long mapped; // in memory (mapped or first read)
+	long scanned; // counted
+	long received; // result received by dispatcher
+	int worker; // thread number or counter pid
+} traceEvent;
+
+// start of a counter process
+typedef struct trace_spawn {
+	int pid;
+	long forked; // fork in dispatcher
+	long started; // first chunk taken by counter
+} traceSpawn;
+
+/*
+ * Current monotonic time in nanoseconds
+ */
+long traceNow();
+
+/*
+ * Prints a summary of where time went - per step average and maximum over
+ * all chunks, and counter start latency.
+ */
+void printTraceSummary(traceEvent* events, int numEvents, traceSpawn* spawns, int numSpawns, long start);
+
+/*
+ * Writes events as a Chrome trace-event JSON file (chrome://tracing,
+ * Perfetto) - a track per worker with map, scan and deliver spans of every
+ * chunk and a spawn span of every counter process.
+ * @param start - time origin of the trace
+ * @return 0 on success, -1 on failure
+ */
+int writeTrace(const char* path, traceEvent* events, int numEvents, traceSpawn* spawns, int numSpawns, long start);
+
+#endif /* COUNT_TRACE_H_ */
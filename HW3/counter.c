@@ -7,25 +7,23 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <errno.h>
-#include <signal.h>
 #include <stdarg.h>
 
-// counter parameters
-#define SLEEP_TIME 1
-#define PIPE_NAME "/tmp/counter_%d"
-#define STR_LEN 1025
+#include "count_engine.h"
+#include "count_io.h"
+#include "count_protocol.h"
+#include "count_trace.h"
+
 
 // output messages
-#define COUNTER_USAGE_ERROR "Usage: counter <character> <filename> <offset> <length>\n"
+#define COUNTER_USAGE_ERROR "Usage: counter <character|substring> <filename> <work fd> <result fd> ["IO_MODE_LIST"]\n"
 #define OFFSET_ERROR "Offset must be a multiplicative of page size\n"
+#define FILE_OPEN_ERROR "Error opening file: %s\n"
 #define FILE_READ_ERROR "Error reading file: %s\n"
+#define ALLOC_ERROR "Error allocating read buffer\n"
 #define FILE_MAP_ERROR "Error mapping file to memory: %s\n"
-#define UNMAP_ERROR "Error un-mapping file: %s\n"
-#define PIPE_CREATE_ERROR "Error creating named pipe: %s\n"
-#define PIPE_OPEN_ERROR "Error opening named pipe: %s\n"
-#define PIPE_WRITE_ERROR "Error writing to named pipe: %s\n"
-#define PIPE_DEL_ERROR "Error deleting named pipe: %s\n"
-#define SIG_SEND_ERROR "Error sending signal: %s\n"
+#define PIPE_READ_ERROR "Error reading from work pipe: %s\n"
+#define PIPE_WRITE_ERROR "Error writing to result pipe: %s\n"
 
 /*
  * Prints output message to stdout.
@@ -40,81 +38,89 @@ void printMsg(char* msg, ...) {
 }
 
 /*
- * Counts number of occurrences of character in a file in a block
- * of given length and starting offset.
+ * Counts number of occurrences of target in an open file in a block
+ * of given length and starting offset, read with given io mode.
+ * available is the number of bytes in file from offset on.
  */
-off_t count(char character, char* filename, off_t offset, off_t length) {
+off_t count(countTarget* target, int fd, off_t offset, off_t length, off_t available,
+		int ioMode, char* buffer, long* mappedAt) {
 	// offset must be a multiplicative of page size
 	if (offset % sysconf(_SC_PAGE_SIZE) != 0) {
 		printMsg(OFFSET_ERROR);
 		return -1;
 	}
 
-	// open file for reading
-	int fd = open(filename, O_RDONLY);
-	if (fd == -1) {
-		printMsg(FILE_READ_ERROR, strerror(errno));
-		return -1;
-	}
+	off_t counter = countFileRange(fd, offset, length, available, target, ioMode, buffer, mappedAt);
+	if (counter == -1)
+		printMsg(ioMode == IO_READ ? FILE_READ_ERROR : FILE_MAP_ERROR, strerror(errno));
+	return counter;
+}
 
-	// map file
-	char* arr = (char*) mmap(NULL, length, PROT_READ , MAP_PRIVATE, fd, offset);
-	if (arr == MAP_FAILED) {
-		printMsg(FILE_MAP_ERROR, strerror(errno));
-		close(fd);
+/*
+ * Writes result record to the dispatcher's result pipe (inherited as resultFd)
+ * returns 0 on success, -1 on failure
+ */
+int sendOutput(int resultFd, counterResult result) {
+	if (write(resultFd, &result, sizeof(result)) != sizeof(result)) {
+		printMsg(PIPE_WRITE_ERROR, strerror(errno));
 		return -1;
 	}
-
-	// count
-	off_t counter = 0;
-	for (off_t i=0; i<length; i++)
-		if (arr[i] == character)
-			counter++;
-
-	// unmap file
-	if (munmap(arr, length) == -1)
-		printMsg(UNMAP_ERROR, strerror(errno));
-	close(fd);
-
-	return counter;
+	return 0;
 }
 
 /*
- * Writes result to named pipe and sends USR1 signal to indicate ready to send result
+ * Takes chunks from the dispatcher's work pipe (inherited as workFd) until it
+ * is empty and closed, counts each and sends its result.
+ * returns 0 on success, -1 on failure
  */
-void sendOutput(off_t counter) {
-	// create pipe
-	char pipeName[STR_LEN];
-	sprintf(pipeName, PIPE_NAME, getpid());
-	if (mkfifo(pipeName, 0777) == -1) {
-		printMsg(PIPE_CREATE_ERROR, strerror(errno));
-		goto CLEANUP;
-	}
+int countChunks(countTarget* target, char* filename, int workFd, int resultFd, int ioMode) {
+	long started = traceNow();
 
-	// send signal to dispatcher
-	////printMsg("Sent Signal\n");
-	if (kill(getppid(), SIGUSR1) == -1) {
-		printMsg (SIG_SEND_ERROR, strerror(errno));
-		goto CLEANUP;
+	// open file for reading - size bounds how far substrings may extend
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		printMsg(FILE_OPEN_ERROR, strerror(errno));
+		if (fd != -1) close(fd);
+		return -1;
 	}
 
-	// open pipe for writing
-	int pipeFd = open(pipeName, O_RDWR);
-	if (pipeFd == -1) {
-		printMsg(PIPE_OPEN_ERROR, strerror(errno));
-		goto CLEANUP;
+	// read buffer - reused for all chunks
+	char* buffer = NULL;
+	if (ioMode == IO_READ && (buffer = (char*) malloc(READ_BUFFER_SIZE)) == NULL) {
+		printMsg(ALLOC_ERROR);
+		close(fd);
+		return -1;
 	}
 
-	// write counter to pipe
-	if (write(pipeFd, &counter, sizeof(off_t)) == -1)
-		printMsg(PIPE_WRITE_ERROR, strerror(errno));
+	int res = 0;
+	counterTask task;
+	ssize_t bytesRead;
+	while ((bytesRead = read(workFd, &task, sizeof(task))) != 0) {
+		if (bytesRead == -1 && errno == EINTR)
+			continue;
+		if (bytesRead != sizeof(task)) {
+			printMsg(PIPE_READ_ERROR, strerror(errno));
+			res = -1;
+			break;
+		}
+
+		// a failed chunk is not reported - dispatcher detects it is missing
+		counterResult result = {task.counterID, getpid(), 0, started, 0, 0};
+		off_t available = st.st_size - task.offset;
+		if (available < task.length) available = task.length;
+		result.count = count(target, fd, task.offset, task.length, available,
+				ioMode, buffer, &result.mapped);
+		result.scanned = traceNow();
+		if (result.count == -1 || sendOutput(resultFd, result) == -1)
+			res = -1;
+	}
 
-	sleep(SLEEP_TIME);
-	CLEANUP:
-	// close and remove pipe
-	if (pipeFd >= 0) close(pipeFd);
-	if (unlink(pipeName) == -1) // delete pipe
-		printMsg(PIPE_DEL_ERROR, strerror(errno));
+	free(buffer);
+	close(fd);
+	close(workFd);
+	close(resultFd);
+	return res;
 }
 
 /*
@@ -142,16 +148,17 @@ off_t toOffset(char* str) {
 
 int main(int argc, char* argv[]) {
 	// validate arguments
-	if (argc < 5 || strlen(argv[1]) != 1 || !isOffset(argv[3]) || !isOffset(argv[4])) {
+	int ioMode = (argc > 5) ? parseIOMode(argv[5]) : IO_MMAP;
+	if (argc < 5 || strlen(argv[1]) == 0 || strlen(argv[1]) > MAX_PATTERN_LENGTH ||
+			!isOffset(argv[3]) || !isOffset(argv[4]) || ioMode == -1) {
 		printMsg(COUNTER_USAGE_ERROR);
 		return -1;
 	}
 
-	// count
-	off_t counter = count(argv[1][0], argv[2], toOffset(argv[3]), toOffset(argv[4]));
-
-	// send output
-	sendOutput(counter);
+	// a single character or a substring
+	int patternLength = strlen(argv[1]);
+	countTarget target = {argv[1][0], patternLength > 1 ? argv[1] : NULL, patternLength, NULL, NULL};
 
-	return counter;
+	// count chunks and send output
+	return countChunks(&target, argv[2], toOffset(argv[3]), toOffset(argv[4]), ioMode);
 }
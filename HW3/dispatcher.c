@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,123 +7,267 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 #include <errno.h>
 #include <signal.h>
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <ftw.h>
+#include <getopt.h>
+
+#include "count_engine.h"
+#include "count_io.h"
+#include "count_protocol.h"
+#include "count_stream.h"
+#include "count_index.h"
+#include "count_trace.h"
 
 // dispatcher parameters
-#define MAX_NUM_COUNTERS 16
-#define NUM_RETRIES 3
-#define PIPE_NAME "/tmp/counter_%d"
+#define MAX_NUM_WORKERS 256
+#define TARGET_CHUNK_SIZE (4*1024*1024) // amortizes mmap and TLB cost of a chunk
+#define MIN_CHUNK_SIZE (64*1024)
+#define NFTW_FDS 32 // directory descriptors held open while walking a tree
+#define OVERSUBSCRIPTION 4 // chunks per worker, for idle workers to take over
 #define COUNTER_EXE "./counter"
+#define OPTIONS "tHsim:c:w:"
+#define TRACE_OPTION "trace"
+#define HISTOGRAM_ALL "all"
+#define STDIN_PATH "-"
+#define STDIN_LABEL "stdin"
 #define STR_LEN 1025
 
 // output messages
-#define DISPATCHER_USAGE_ERROR "Usage: dispatcher <character> <filename>\n"
+#define DISPATCHER_USAGE_ERROR "Usage: dispatcher [-t] [-i] [-m "IO_MODE_LIST"] [-c <chunk size>] [-w <workers>] [--"TRACE_OPTION" <json file>] <character> <file|directory>...|"STDIN_PATH"|<pipe>\n" \
+		"       dispatcher -H [-i] [-m "IO_MODE_LIST"] [-c <chunk size>] [-w <workers>] [--"TRACE_OPTION" <json file>] <characters|"HISTOGRAM_ALL"> <file|directory>...|"STDIN_PATH"|<pipe>\n" \
+		"       dispatcher -s [-t] [-m "IO_MODE_LIST"] [-c <chunk size>] [-w <workers>] [--"TRACE_OPTION" <json file>] <substring> <file|directory>...\n"
 #define FILE_NOT_FOUND_ERROR "Error getting file size: %s\n"
-#define SIG_REGISTER_ERROR "Error registering signal handle: %s\n"
-#define PIPE_OPEN_ERROR "Error opening named pipe: %s\n"
-#define PIPE_READ_ERROR "Error reading from named pipe: %s\n"
+#define WALK_ERROR "Skipping unreadable %s\n"
+#define INDEX_FILES_ERROR "Count index (-i) needs a single file\n"
+#define SUBSTRING_MODE_ERROR "Substring mode (-s) does not support histograms, count index or stream input\n"
+#define ALLOC_ERROR "Error allocating memory\n"
+#define PIPE_CREATE_ERROR "Error creating pipe: %s\n"
+#define PIPE_READ_ERROR "Error reading from result pipe: %s\n"
+#define PIPE_WRITE_ERROR "Error writing to work pipe: %s\n"
+#define RESULT_ERROR "Received malformed counter result\n"
 #define FORK_ERROR "Error creating fork: %s\n"
 #define EXECV_ERROR "Error executing counter: %s\n"
-#define GIVEUP_ERROR "Retried several times, giving up\n"
+#define COUNTER_FAILED_ERROR "Some counters did not return a result\n"
+#define FILE_OPEN_ERROR "Error opening file: %s\n"
+#define FILE_MAP_ERROR "Error mapping file to memory: %s\n"
+#define FILE_READ_ERROR "Error reading file: %s\n"
+#define THREAD_CREATE_ERROR "Error creating thread\n"
 #define OUTPUT_MSG "The character '%c' appears %lu times in %s\n"
+#define BYTE_OUTPUT_MSG "The byte 0x%02x appears %lu times in %s\n"
+#define TOTAL_OUTPUT_MSG "The character '%c' appears %lu times in %d files\n"
+#define SUBSTRING_OUTPUT_MSG "The string \"%s\" appears %lu times in %s\n"
+#define SUBSTRING_TOTAL_OUTPUT_MSG "The string \"%s\" appears %lu times in %d files\n"
+#define FILES_LABEL "%d files"
+
+// file being counted
+typedef struct counted_file {
+	char* name;
+	off_t size;
+	off_t count;
+} countedFile;
 
-// structure containing counter state and parameters
+// structure containing state and parameters of a chunk of a file
 typedef struct counter_state {
+	int fileID;
 	off_t offset;
 	off_t length;
 	off_t count;
-	int pid;
+	int pid; // -1 when chunk is done
 } counterState;
 
-// state of all counters - in order to account for missing counters
-counterState COUNTERS[MAX_NUM_COUNTERS];
+// all files to count (in walk order)
+countedFile* FILES = NULL;
+int numFiles = 0;
+int filesCapacity = 0;
+
+// state of all chunks - in order to account for missing results
+counterState* COUNTERS = NULL;
 int numCounters = 0;
+// units of work handed to threads - unit i is chunks UNITS[i]..UNITS[i+1]-1,
+// a single chunk of a large file or a batch of whole small files
+int* UNITS = NULL;
+int numUnits = 0;
+int numWorkers = 0;
+int ioMode = IO_MMAP;
+// substring mode - counted instead of a single character, NULL otherwise
+char* pattern = NULL;
+int patternLength = 0;
+// partitioning overrides, 0 for adaptive
+off_t fixedChunkSize = 0;
+int fixedWorkers = 0;
+
+// count index mode - per chunk histograms of a single file, chunks whose
+// counts were loaded from the index are marked in INDEX_VALID (and done)
+int useIndex = 0;
+indexChunk* INDEX = NULL;
+char* INDEX_VALID = NULL;
+indexStamp INDEX_STAMP; // version of the file being counted
+
+// tracing - timestamps of every chunk and counter process, NULL if not traced
+char* tracePath = NULL;
+long traceStart = 0;
+traceEvent* TRACE = NULL;
+traceSpawn* SPAWNS = NULL;
+int numSpawns = 0;
+
+// shared state of counting threads (in-process mode)
+typedef struct thread_pool {
+	char character;
+	char* arr; // whole file mapping of a single file, NULL otherwise
+	int nextUnit;
+	int nextThread; // thread numbers for tracing
+	int failed;
+	off_t* histogram; // histogram mode - merged result of all threads, NULL otherwise
+	pthread_mutex_t histogramLock;
+} threadPool;
 
 /*
- * Handle counter signal (when a counter is ready to return its result)
- * reads result from named pipe and saves to COUNTERS state.
+ * Number of workers (threads or counter processes) to run - one per core
+ * this process may run on
  */
-void counterSignalHandler (int signum, siginfo_t* info, void* ptr) {
-	char pipeName[STR_LEN];
-	sprintf(pipeName, PIPE_NAME, info->si_pid);
-	////printf("Received signal from %d\n",info->si_pid);
-
-	// get index in COUNTERS for specific pid
-	int counterID = 0;
-	for (counterID = 0; counterID < numCounters; counterID++)
-		if (COUNTERS[counterID].pid == info->si_pid) break;
+int getNumWorkers() {
+	int cores = 0;
+	cpu_set_t cpuSet;
+	if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+		cores = CPU_COUNT(&cpuSet);
+	if (cores <= 0)
+		cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cores <= 0)
+		cores = 1;
+	return cores < MAX_NUM_WORKERS ? cores : MAX_NUM_WORKERS;
+}
 
-	// open pipe
-	int pipeFd = open(pipeName, O_RDONLY);
-	if (pipeFd == -1) {
-		printf(PIPE_OPEN_ERROR, strerror(errno));
-		return;
+/*
+ * nftw callback - adds a regular file to FILES
+ */
+int addFile(const char* path, const struct stat* st, int type, struct FTW* ftwBuf) {
+	if (type == FTW_DNR || type == FTW_NS) {
+		printf(WALK_ERROR, path);
+		return 0;
 	}
+	if (type != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
 
-	// read counter from pipe
-	if (read(pipeFd, &(COUNTERS[counterID].count), sizeof(off_t)) != sizeof(off_t)) {
-		printf(PIPE_READ_ERROR, strerror(errno));
-		return;
+	// grow files array
+	if (numFiles == filesCapacity) {
+		int capacity = filesCapacity ? 2 * filesCapacity : 64;
+		countedFile* files = (countedFile*) realloc(FILES, capacity * sizeof(countedFile));
+		if (files == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+		FILES = files;
+		filesCapacity = capacity;
 	}
-	close(pipeFd);
 
-	// set counter state to done
-	COUNTERS[counterID].pid = -1;
+	if ((FILES[numFiles].name = strdup(path)) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	FILES[numFiles].size = st->st_size;
+	FILES[numFiles].count = 0;
+	numFiles++;
+	return 0;
 }
 
-
 /*
- * Split file into blocks and write to COUNTERS state
+ * Collect files (walking directories) and split them into chunks and units
+ * of work, written to COUNTERS and UNITS.
+ * Chunks are TARGET_CHUNK_SIZE long, smaller when all files together are too
+ * small to give every worker OVERSUBSCRIPTION chunks, but at least
+ * MIN_CHUNK_SIZE. Files smaller than a chunk are one chunk each, and are
+ * batched into units of about a chunk's size.
+ * Chunk size and number of workers may be fixed by options instead.
+ * In count index mode chunks are always INDEX_CHUNK_SIZE.
+ * Sets numWorkers to the number of cores, at most one per unit.
  * returns 0 on success, -1 on failure
  */
-int prepareCounters(char* filename) {
-	// get file size (and check if exists)
-	struct stat st;
-	if (stat(filename, &st) == -1) {
-		printf(FILE_NOT_FOUND_ERROR, strerror(errno));
-		return -1;
+int prepareCounters(char** paths, int numPaths) {
+	// collect files (and check they exist)
+	for (int i=0; i<numPaths; i++) {
+		if (nftw(paths[i], addFile, NFTW_FDS, FTW_PHYS) == -1) {
+			printf(FILE_NOT_FOUND_ERROR, strerror(errno));
+			return -1;
+		}
 	}
-	off_t N = st.st_size;
+	off_t N = 0;
+	for (int i=0; i<numFiles; i++)
+		N += FILES[i].size;
 
-	// calculate number of counters to run and number of characters each counter processes
-	int pageSize = sysconf(_SC_PAGE_SIZE);
-	off_t blockSize, numPages = N/pageSize + (N%pageSize>0);
-	if (numPages <= 2) // for small files run one counter
-		blockSize = 2 * pageSize;
-	else if (numPages < MAX_NUM_COUNTERS) // for medium files run a small number counters
-		blockSize = pageSize;
-	else // for large files run MAX_NUM_COUNTERS counters
-		blockSize = pageSize * (numPages/MAX_NUM_COUNTERS + (numPages%MAX_NUM_COUNTERS>0));
+	// calculate chunk size - page aligned for mapping chunks separately
+	numWorkers = fixedWorkers ? fixedWorkers : getNumWorkers();
+	off_t pageSize = sysconf(_SC_PAGE_SIZE);
+	off_t chunkSize = N / (numWorkers * OVERSUBSCRIPTION);
+	if (chunkSize > TARGET_CHUNK_SIZE) chunkSize = TARGET_CHUNK_SIZE;
+	if (chunkSize < MIN_CHUNK_SIZE) chunkSize = MIN_CHUNK_SIZE;
+	// a fixed chunk longer than all files is one chunk per file - capping it
+	// also keeps page rounding from overflowing
+	if (fixedChunkSize)
+		chunkSize = (fixedChunkSize <= N) ? fixedChunkSize : (N > 0 ? N : pageSize);
+	chunkSize = (chunkSize + pageSize - 1) / pageSize * pageSize;
+	if (useIndex)
+		chunkSize = INDEX_CHUNK_SIZE;
 
-	// prepare counters
+	// prepare chunks
 	numCounters = 0;
-	counterState state;
-	for (off_t offset=0; offset<N; offset+=blockSize) {
-		COUNTERS[numCounters].pid = 0;
-		COUNTERS[numCounters].count = 0;
-		COUNTERS[numCounters].offset = offset;
-		// prevent overflow of last counter
-		if (offset + blockSize > N)
-			COUNTERS[numCounters].length = N-offset;
-		else
-			COUNTERS[numCounters].length = blockSize;
-		numCounters++;
+	for (int i=0; i<numFiles; i++)
+		numCounters += FILES[i].size/chunkSize + (FILES[i].size%chunkSize>0);
+	COUNTERS = (counterState*) malloc((numCounters + 1) * sizeof(counterState));
+	UNITS = (int*) malloc((numCounters + 1) * sizeof(int));
+	if (COUNTERS == NULL || UNITS == NULL) {
+		printf(ALLOC_ERROR);
+		return -1;
 	}
 
+	int counterID = 0;
+	off_t unitSize = chunkSize; // start a new unit with first chunk
+	numUnits = 0;
+	for (int i=0; i<numFiles; i++) {
+		for (off_t offset=0; offset<FILES[i].size; offset+=chunkSize) {
+			COUNTERS[counterID].fileID = i;
+			COUNTERS[counterID].pid = 0;
+			COUNTERS[counterID].count = 0;
+			COUNTERS[counterID].offset = offset;
+			// prevent overflow of last chunk
+			if (offset + chunkSize > FILES[i].size)
+				COUNTERS[counterID].length = FILES[i].size - offset;
+			else
+				COUNTERS[counterID].length = chunkSize;
+
+			// close unit once it is about a chunk long
+			if (unitSize >= chunkSize) {
+				UNITS[numUnits++] = counterID;
+				unitSize = 0;
+			}
+			unitSize += COUNTERS[counterID].length;
+			counterID++;
+		}
+	}
+	UNITS[numUnits] = numCounters;
+	if (numWorkers > numUnits) numWorkers = numUnits;
+
 	return 0;
 }
 
 /*
- * Dispatches a counter on a block of given length and starting offset
+ * Dispatches a counter that counts the chunks it reads from workFd and
+ * writes a result for each of them to resultFd.
  * returns (to dispatcher) counter pid on success, -1 on failure
  */
-int dispatchCounter(char character, char* filename, off_t offset, off_t length) {
-	// set arguments for counter
-	char offsetStr[STR_LEN], lengthStr[STR_LEN];
-	char* args[] = {COUNTER_EXE, &character, filename, offsetStr, lengthStr, NULL};
-	sprintf(offsetStr, "%lu", offset);
-	sprintf(lengthStr, "%lu", length);
+int dispatchCounter(char character, char* filename, int workFd, int resultFd) {
+	// set arguments for counter - a character or a substring
+	char charStr[2] = {character, '\0'};
+	char workFdStr[STR_LEN], resultFdStr[STR_LEN];
+	char* ioModeNames[] = IO_MODE_NAMES;
+	char* args[] = {COUNTER_EXE, pattern != NULL ? pattern : charStr, filename, workFdStr, resultFdStr, ioModeNames[ioMode], NULL};
+	sprintf(workFdStr, "%d", workFd);
+	sprintf(resultFdStr, "%d", resultFd);
 
 	// fork
 	int f = fork();
@@ -133,32 +278,121 @@ int dispatchCounter(char character, char* filename, off_t offset, off_t length)
 	else if (f==0) { // child process
 		execv(args[0],args);
 		printf(EXECV_ERROR, strerror(errno));
-		return -1;
+		exit(-1);
 	}
 	else // successful fork - return child pid
 		return f;
 }
 
 /*
- * Dispatch all counters that are not marked as done, that is have a pid != -1
- * Save pid for later reference (to mark as done)
- * Wait on all counters to finish running
+ * Work feeding thread - writes a task record of every chunk to the work pipe
+ * (workFd), then closes it so counters get EOF when no chunks are left.
+ * Runs beside the result reading loop, so a full result pipe can not block it.
+ */
+void* feedWork(void* workFdPtr) {
+	int workFd = *((int*) workFdPtr);
+	for (int i=0; i<numCounters; i++) {
+		counterTask task = {i, COUNTERS[i].offset, COUNTERS[i].length};
+		if (TRACE != NULL)
+			TRACE[i].dispatched = traceNow();
+		if (write(workFd, &task, sizeof(task)) != sizeof(task)) {
+			printf(PIPE_WRITE_ERROR, strerror(errno));
+			break;
+		}
+	}
+	close(workFd);
+	return NULL;
+}
+
+/*
+ * Records timestamps of a counter result in TRACE and SPAWNS
+ */
+void traceResult(counterResult* result) {
+	traceEvent* event = &TRACE[result->counterID];
+	event->mapped = result->mapped;
+	event->scanned = result->scanned;
+	event->received = traceNow();
+	event->worker = result->pid;
+	for (int i=0; i<numSpawns; i++)
+		if (SPAWNS[i].pid == result->pid && SPAWNS[i].started == 0)
+			SPAWNS[i].started = result->started;
+}
+
+/*
+ * Dispatch numWorkers counters sharing a work pipe and a result pipe.
+ * Chunks are handed out through the work pipe - a counter takes the next
+ * chunk whenever it is idle. Reads result records until every counter has
+ * exited (closed its end of the result pipe), marks each reported chunk as
+ * done (pid == -1) and reaps the counters.
+ * returns 0 on success, -1 on failure
  */
-int dispatchWaitingCounters(char character, char* filename) {
+int dispatchCounters(char character, char* filename) {
 	int res = 0;
 
-	// run counters waiting to be run and save pid
-	for (int i=0; i<numCounters; i++) {
-		if (COUNTERS[i].pid != -1) {
-			COUNTERS[i].pid = dispatchCounter(character, filename, COUNTERS[i].offset, COUNTERS[i].length);
+	// create pipes - dispatcher ends are not passed on to counters
+	int workPipe[2], resultPipe[2];
+	if (pipe(workPipe) == -1) {
+		printf(PIPE_CREATE_ERROR, strerror(errno));
+		return -1;
+	}
+	if (pipe(resultPipe) == -1) {
+		printf(PIPE_CREATE_ERROR, strerror(errno));
+		close(workPipe[0]);
+		close(workPipe[1]);
+		return -1;
+	}
+	fcntl(workPipe[1], F_SETFD, FD_CLOEXEC);
+	fcntl(resultPipe[0], F_SETFD, FD_CLOEXEC);
 
-			// if dispatch fails, do not run more counters
-			if (COUNTERS[i].pid == -1) {
-				res = -1;
-				break;
-			}
+	// run counters
+	for (int i=0; i<numWorkers; i++) {
+		long forked = traceNow();
+		int pid = dispatchCounter(character, filename, workPipe[0], resultPipe[1]);
+		// if dispatch fails, do not run more counters
+		if (pid == -1) {
+			res = -1;
+			break;
+		}
+		if (SPAWNS != NULL)
+			SPAWNS[numSpawns++] = (traceSpawn) {pid, forked, 0};
+	}
+	close(workPipe[0]);
+	close(resultPipe[1]);
+
+	// hand out chunks - if all counters died (or never ran), feeding the work
+	// pipe must fail with EPIPE rather than kill the dispatcher
+	signal(SIGPIPE, SIG_IGN);
+	pthread_t feeder;
+	int feeding = (pthread_create(&feeder, NULL, feedWork, &workPipe[1]) == 0);
+	if (!feeding) {
+		printf(THREAD_CREATE_ERROR);
+		close(workPipe[1]);
+		res = -1;
+	}
+
+	// read results until all counters are done - ignore syscall interrupts
+	counterResult result;
+	ssize_t bytesRead;
+	while ((bytesRead = read(resultPipe[0], &result, sizeof(result))) != 0) {
+		if (bytesRead == -1) {
+			if (errno == EINTR) continue;
+			printf(PIPE_READ_ERROR, strerror(errno));
+			res = -1;
+			break;
+		}
+		if (bytesRead != sizeof(result) || result.counterID < 0 || result.counterID >= numCounters) {
+			printf(RESULT_ERROR);
+			res = -1;
+			continue;
 		}
+		COUNTERS[result.counterID].count = result.count;
+		COUNTERS[result.counterID].pid = -1;
+		if (TRACE != NULL)
+			traceResult(&result);
 	}
+	close(resultPipe[0]);
+	if (feeding)
+		pthread_join(feeder, NULL);
 
 	// wait on counters, ignore syscall interrupts
 	while (wait(NULL) != -1 || errno == EINTR);
@@ -166,6 +400,150 @@ int dispatchWaitingCounters(char character, char* filename) {
 	return res;
 }
 
+/*
+ * Counting thread (in-process mode) - takes the next chunk of COUNTERS not yet
+ * taken by some thread, counts it in the shared mapping and marks it as done.
+ * Runs until no chunks are left.
+ * In histogram mode chunks are counted into a private histogram which is
+ * merged into the pool histogram once, when the thread is done.
+ */
+void* countingThread(void* poolPtr) {
+	threadPool* pool = (threadPool*) poolPtr;
+	off_t histogram[HISTOGRAM_SIZE] = {0};
+	off_t* threadHistogram = (pool->histogram != NULL) ? histogram : NULL;
+	countTarget target = {pool->character, pattern, patternLength, NULL, NULL};
+
+	// read buffer of this thread - reused for all chunks
+	char* buffer = NULL;
+	if (ioMode == IO_READ && (buffer = (char*) malloc(READ_BUFFER_SIZE)) == NULL) {
+		printf(ALLOC_ERROR);
+		pool->failed = 1;
+		return NULL;
+	}
+
+	// file of last counted chunk - kept open for next chunks of the same file
+	int fd = -1, fdFileID = -1;
+	int threadNum = __sync_fetch_and_add(&(pool->nextThread), 1);
+	long mappedAt = 0;
+
+	int unitID;
+	while ((unitID = __sync_fetch_and_add(&(pool->nextUnit), 1)) < numUnits) {
+		for (int counterID = UNITS[unitID]; counterID < UNITS[unitID+1]; counterID++) {
+			counterState* chunk = &COUNTERS[counterID];
+			if (chunk->pid == -1) // loaded from count index
+				continue;
+			// count index mode - all byte values and the checksum of every chunk are kept
+			target.histogram = (INDEX != NULL) ? INDEX[counterID].histogram : threadHistogram;
+			if (INDEX != NULL) {
+				INDEX[counterID].checksum = CHECKSUM_SEED;
+				target.checksum = &INDEX[counterID].checksum;
+			}
+			off_t available = FILES[chunk->fileID].size - chunk->offset;
+			if (TRACE != NULL) {
+				TRACE[counterID].dispatched = traceNow();
+				TRACE[counterID].worker = threadNum;
+			}
+
+			// single mapped file - count in place
+			if (pool->arr != NULL) {
+				chunk->count = countTargetInBuffer(pool->arr + chunk->offset, chunk->length, available, &target);
+				if (INDEX != NULL)
+					chunk->count = target.histogram[(unsigned char) pool->character];
+				chunk->pid = -1;
+				if (TRACE != NULL) { // already mapped, no result delivery
+					TRACE[counterID].mapped = TRACE[counterID].dispatched;
+					TRACE[counterID].scanned = traceNow();
+				}
+				continue;
+			}
+
+			// otherwise bring chunk to memory with io mode
+			if (chunk->fileID != fdFileID) {
+				if (fd != -1) close(fd);
+				fdFileID = chunk->fileID;
+				if ((fd = open(FILES[fdFileID].name, O_RDONLY)) == -1) {
+					printf(FILE_OPEN_ERROR, strerror(errno));
+					pool->failed = 1;
+					continue;
+				}
+			}
+			if (fd == -1) // file failed to open
+				continue;
+			chunk->count = countFileRange(fd, chunk->offset, chunk->length, available,
+					&target, ioMode, buffer, &mappedAt);
+			if (chunk->count == -1) {
+				printf(ioMode == IO_READ ? FILE_READ_ERROR : FILE_MAP_ERROR, strerror(errno));
+				pool->failed = 1;
+				continue;
+			}
+			if (INDEX != NULL)
+				chunk->count = target.histogram[(unsigned char) pool->character];
+			chunk->pid = -1;
+			if (TRACE != NULL) { // no result delivery
+				TRACE[counterID].mapped = mappedAt;
+				TRACE[counterID].scanned = traceNow();
+			}
+		}
+	}
+	if (fd != -1) close(fd);
+	free(buffer);
+
+	if (pool->histogram != NULL) {
+		pthread_mutex_lock(&(pool->histogramLock));
+		for (int c=0; c < HISTOGRAM_SIZE; c++)
+			pool->histogram[c] += histogram[c];
+		pthread_mutex_unlock(&(pool->histogramLock));
+	}
+	return NULL;
+}
+
+/*
+ * Count all units of UNITS in-process with numWorkers counting threads.
+ * A single file is mapped once and shared by all threads (unless reading
+ * with IO_READ), chunks of multiple files are brought into memory one by one.
+ * Results are written directly to COUNTERS, no processes, pipes or signals.
+ * If histogram is not NULL counts all byte values into it instead of character.
+ * returns 0 on success, -1 on failure
+ */
+int countInThreads(char character, off_t* histogram) {
+	if (numCounters == 0) // empty files
+		return 0;
+
+	threadPool pool = {character, NULL, 0, 0, 0, histogram, PTHREAD_MUTEX_INITIALIZER};
+
+	// map single file once
+	if (numFiles == 1 && ioMode != IO_READ) {
+		int fd = open(FILES[0].name, O_RDONLY);
+		if (fd == -1) {
+			printf(FILE_OPEN_ERROR, strerror(errno));
+			return -1;
+		}
+		pool.arr = mapFileRange(fd, 0, FILES[0].size, ioMode);
+		close(fd);
+		if (pool.arr == MAP_FAILED) {
+			printf(FILE_MAP_ERROR, strerror(errno));
+			return -1;
+		}
+	}
+
+	// run threads - calling thread counts as well
+	pthread_t threads[MAX_NUM_WORKERS];
+	int numStarted = 1;
+	for (; numStarted < numWorkers; numStarted++) {
+		if (pthread_create(&threads[numStarted], NULL, countingThread, &pool)) {
+			printf(THREAD_CREATE_ERROR);
+			break;
+		}
+	}
+	countingThread(&pool);
+	for (int i=1; i < numStarted; i++)
+		pthread_join(threads[i], NULL);
+
+	if (pool.arr != NULL)
+		munmap(pool.arr, FILES[0].size);
+	return pool.failed ? -1 : 0;
+}
+
 /*
  * Check if all counters are marked as done, that is pid == -1
  */
@@ -177,55 +555,317 @@ int allDone() {
 }
 
 /*
- * Counts number of occurrences of some character (argv[1]) in a file (argv[2])
- * In case of signal misses tries again several times.
+ * Prints histogram counts of the characters in chars, in given order and
+ * without repetitions. If chars is HISTOGRAM_ALL prints all byte values that
+ * appear in the file.
+ */
+void printHistogram(off_t* histogram, char* chars, char* filename) {
+	if (strcmp(chars, HISTOGRAM_ALL) == 0) {
+		for (int c=0; c < HISTOGRAM_SIZE; c++) {
+			if (histogram[c] == 0) continue;
+			if (isprint(c))
+				printf(OUTPUT_MSG, c, histogram[c], filename);
+			else
+				printf(BYTE_OUTPUT_MSG, c, histogram[c], filename);
+		}
+		return;
+	}
+
+	char printed[HISTOGRAM_SIZE] = {0};
+	for (unsigned char* c = (unsigned char*) chars; *c; c++) {
+		if (printed[*c]) continue;
+		printed[*c] = 1;
+		printf(OUTPUT_MSG, *c, histogram[*c], filename);
+	}
+}
+
+/*
+ * Loads count index of the single counted file - chunks with valid indexed
+ * counts are marked as done
+ * returns 0 on success, -1 on failure
+ */
+int loadIndex(char character) {
+	INDEX = (indexChunk*) calloc(numCounters + 1, sizeof(indexChunk));
+	INDEX_VALID = (char*) calloc(numCounters + 1, 1);
+	if (INDEX == NULL || INDEX_VALID == NULL) {
+		printf(ALLOC_ERROR);
+		return -1;
+	}
+	if (loadCountIndex(FILES[0].name, numCounters, INDEX, INDEX_VALID, &INDEX_STAMP) == -1) {
+		// unreadable index - count all
+		memset(INDEX, 0, numCounters * sizeof(indexChunk));
+		memset(INDEX_VALID, 0, numCounters);
+	}
+	for (int i=0; i<numCounters; i++) {
+		if (!INDEX_VALID[i]) continue;
+		COUNTERS[i].count = INDEX[i].histogram[(unsigned char) character];
+		COUNTERS[i].pid = -1;
+	}
+	return 0;
+}
+
+/*
+ * Parses a positive size with an optional K/M/G suffix
+ * returns size, -1 if not a valid size (or too large)
+ */
+off_t parseSize(char* str) {
+	char* end;
+	errno = 0;
+	long long size = strtoll(str, &end, 10);
+	if (end == str || errno == ERANGE || size <= 0)
+		return -1;
+	long long multiplier = 1;
+	switch (*end) {
+	case 'G': case 'g': multiplier *= 1024;
+	// fall through
+	case 'M': case 'm': multiplier *= 1024;
+	// fall through
+	case 'K': case 'k': multiplier *= 1024;
+		end++;
+	}
+	if (*end != '\0' || size > LLONG_MAX / multiplier)
+		return -1;
+	return size * multiplier;
+}
+
+/*
+ * Parses a positive integer of at most max - no suffixes
+ * returns number, -1 if not a valid number
+ */
+int parseCount(char* str, int max) {
+	char* end;
+	errno = 0;
+	long count = strtol(str, &end, 10);
+	if (end == str || *end != '\0' || errno == ERANGE || count <= 0 || count > max)
+		return -1;
+	return (int) count;
+}
+
+/*
+ * Allocates trace records of all chunks and counters
+ * returns 0 on success, -1 on failure
+ */
+int prepareTrace() {
+	TRACE = (traceEvent*) calloc(numCounters + 1, sizeof(traceEvent));
+	SPAWNS = (traceSpawn*) calloc(numWorkers + 1, sizeof(traceSpawn));
+	if (TRACE == NULL || SPAWNS == NULL) {
+		printf(ALLOC_ERROR);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Prints trace summary and writes trace file, if tracing
+ */
+void finishTrace() {
+	if (TRACE == NULL)
+		return;
+	printTraceSummary(TRACE, numCounters, SPAWNS, numSpawns, traceStart);
+	writeTrace(tracePath, TRACE, numCounters, SPAWNS, numSpawns, traceStart);
+}
+
+/*
+ * Check if path is a non-seekable input to be counted as a stream - STDIN_PATH,
+ * a named pipe, a socket or a character device
+ */
+int isStream(char* path) {
+	struct stat st;
+	if (strcmp(path, STDIN_PATH) == 0)
+		return 1;
+	return stat(path, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode) || S_ISSOCK(st.st_mode));
+}
+
+/*
+ * Counts a non-seekable input (a single path) as a stream and prints result
+ * returns 0 on success, -1 on failure
+ */
+int countStreamPath(char* characters, char* path, int useHistogram) {
+	int fd = STDIN_FILENO;
+	char* label = STDIN_LABEL;
+	if (strcmp(path, STDIN_PATH) != 0) {
+		label = path;
+		if ((fd = open(path, O_RDONLY)) == -1) {
+			printf(FILE_OPEN_ERROR, strerror(errno));
+			return -1;
+		}
+	}
+
+	off_t count = 0, histogram[HISTOGRAM_SIZE] = {0};
+	int res = countStream(fd, characters[0], fixedWorkers ? fixedWorkers : getNumWorkers(), &count, useHistogram ? histogram : NULL);
+	if (fd != STDIN_FILENO)
+		close(fd);
+	if (res == -1)
+		return -1;
+
+	if (useHistogram)
+		printHistogram(histogram, characters, label);
+	else
+		printf(OUTPUT_MSG, characters[0], count, label);
+	return 0;
+}
+
+/*
+ * Counts number of occurrences of some character in files and directory trees
+ * Options:
+ *   -t - count in-process on a pool of threads instead of dispatching
+ *        counter processes.
+ *   -H - count a set of characters (or HISTOGRAM_ALL byte values) in one
+ *        in-process pass.
+ *   -m <io mode> - how chunks are brought into memory (see count_io.h)
+ *   -s - count (possibly overlapping) occurrences of a substring.
+ *   -i - keep per chunk counts of a single file in a count index (see
+ *        count_index.h) and only count chunks not in the index.
+ *   -c <chunk size> - fixed chunk size (with K/M/G suffix) instead of adaptive.
+ *   -w <workers> - fixed number of threads or counter processes instead of
+ *        one per core.
+ *   --trace <json file> - record timestamps of every chunk, print a summary
+ *        and write a Chrome trace (see count_trace.h).
+ * Counter processes count a single file - multiple files are always counted
+ * in-process. A single STDIN_PATH or pipe is read as a stream by the
+ * dispatcher and counted by threads.
  */
 int main (int argc, char** argv) {
+	traceStart = traceNow();
+
+	// parse options - histogram mode is always in-process
+	struct option longOptions[] = {{TRACE_OPTION, required_argument, NULL, 'T'}, {NULL, 0, NULL, 0}};
+	int useThreads = 0, useHistogram = 0, useSubstring = 0, opt;
+	while ((opt = getopt_long(argc, argv, OPTIONS, longOptions, NULL)) != -1) {
+		switch (opt) {
+		case 'T':
+			tracePath = optarg;
+			break;
+		case 't':
+			useThreads = 1;
+			break;
+		case 'H':
+			useThreads = useHistogram = 1;
+			break;
+		case 'i':
+			useIndex = 1;
+			break;
+		case 's':
+			useSubstring = 1;
+			break;
+		case 'c':
+			if ((fixedChunkSize = parseSize(optarg)) > 0)
+				break;
+			printf(DISPATCHER_USAGE_ERROR);
+			return -1;
+		case 'w':
+			if ((fixedWorkers = parseCount(optarg, MAX_NUM_WORKERS)) != -1)
+				break;
+			printf(DISPATCHER_USAGE_ERROR);
+			return -1;
+		case 'm':
+			if ((ioMode = parseIOMode(optarg)) != -1)
+				break;
+			// fall through - unknown io mode
+		default:
+			printf(DISPATCHER_USAGE_ERROR);
+			return -1;
+		}
+	}
+
 	// validate arguments
-	if (argc < 3 || strlen(argv[1]) != 1) {
+	if (argc - optind < 2 || strlen(argv[optind]) == 0 ||
+			(!useHistogram && !useSubstring && strlen(argv[optind]) != 1) ||
+			strlen(argv[optind]) > MAX_PATTERN_LENGTH) {
 		printf(DISPATCHER_USAGE_ERROR);
 		return -1;
 	}
-	char character = argv[1][0];
-	char* filename = argv[2];
+	char* characters = argv[optind];
+	char character = characters[0];
+
+	// substring mode - single characters are counted as before
+	if (useSubstring) {
+		if (useHistogram || useIndex || (argc - optind == 2 && isStream(argv[optind + 1]))) {
+			printf(SUBSTRING_MODE_ERROR);
+			return -1;
+		}
+		pattern = characters;
+		patternLength = strlen(pattern);
+	}
+
+	// streaming input - can not be split into chunks in advance
+	if (argc - optind == 2 && isStream(argv[optind + 1]))
+		return countStreamPath(characters, argv[optind + 1], useHistogram);
 
 	// decide how many counters will be run on on what block size
-	if (prepareCounters(filename) == -1)
+	if (prepareCounters(argv + optind + 1, argc - optind - 1) == -1)
 		return -1;
-
-	// register signal handler (code from recitation)
-	struct sigaction new_action;
-	sigemptyset(&new_action.sa_mask);
-	new_action.sa_sigaction = counterSignalHandler;
-	new_action.sa_flags = SA_SIGINFO;
-	if (0 != sigaction(SIGUSR1, &new_action, NULL)) {
-		printf(SIG_REGISTER_ERROR, strerror(errno));
+	if (numFiles != 1)
+		useThreads = 1;
+	if (tracePath != NULL && prepareTrace() == -1)
 		return -1;
+
+	// count index mode - in-process, only chunks not in the index are counted
+	if (useIndex) {
+		if (numFiles != 1) {
+			printf(INDEX_FILES_ERROR);
+			return -1;
+		}
+		useThreads = 1;
+		if (loadIndex(character) == -1)
+			return -1;
 	}
 
-	// Try dispatching counters. If error occurs during dispatching then quit.
-	// If some counter does not return (probably due to signal miss),
-	// run again all non returning counters.
-	// Retries at most as number of counters - for the case of signal miss we get
-	// at least one successful counter per a run.
-	int retries = 0;
-	while (!allDone() && retries < numCounters) {
-		if (dispatchWaitingCounters(character, filename) == -1)
-			return -1;; // quit if dispatch fails
-		retries++;
+	// histogram mode - count all byte values in one pass and print selected
+	if (useHistogram) {
+		off_t histogram[HISTOGRAM_SIZE] = {0};
+		if (countInThreads(character, useIndex ? NULL : histogram) == -1)
+			return -1;
+		if (useIndex) { // histogram is the sum of all chunks
+			saveCountIndex(FILES[0].name, &INDEX_STAMP, FILES[0].size, numCounters, INDEX);
+			for (int i=0; i<numCounters; i++)
+				for (int c=0; c < HISTOGRAM_SIZE; c++)
+					histogram[c] += INDEX[i].histogram[c];
+		}
+		char label[STR_LEN];
+		if (numFiles == 1)
+			snprintf(label, STR_LEN, "%s", FILES[0].name);
+		else
+			snprintf(label, STR_LEN, FILES_LABEL, numFiles);
+		printHistogram(histogram, characters, label);
+		finishTrace();
+		return 0;
 	}
 
+	// in-process mode - no counter processes
+	if (useThreads) {
+		if (countInThreads(character, NULL) == -1)
+			return -1;
+	}
+	else if (dispatchCounters(character, FILES[0].name) == -1)
+		return -1;
+
 	// when done
 	if (allDone()) { // success - accumulate and print output
+		if (useIndex)
+			saveCountIndex(FILES[0].name, &INDEX_STAMP, FILES[0].size, numCounters, INDEX);
+
 		off_t totalCount = 0;
-		for (int i=0; i<numCounters; i++)
+		for (int i=0; i<numCounters; i++) {
+			FILES[COUNTERS[i].fileID].count += COUNTERS[i].count;
 			totalCount += COUNTERS[i].count;
+		}
 
-		printf(OUTPUT_MSG, character, totalCount, filename);
+		for (int i=0; i<numFiles; i++) {
+			if (pattern != NULL)
+				printf(SUBSTRING_OUTPUT_MSG, pattern, FILES[i].count, FILES[i].name);
+			else
+				printf(OUTPUT_MSG, character, FILES[i].count, FILES[i].name);
+		}
+		if (numFiles != 1 && pattern != NULL)
+			printf(SUBSTRING_TOTAL_OUTPUT_MSG, pattern, totalCount, numFiles);
+		else if (numFiles != 1)
+			printf(TOTAL_OUTPUT_MSG, character, totalCount, numFiles);
+		finishTrace();
 		return 0;
 	}
-	else { // gave up on retries
-		printf(GIVEUP_ERROR);
+	else { // some counter failed
+		printf(COUNTER_FAILED_ERROR);
 		return -1;
 	}
 }
@@ -0,0 +1,95 @@
+#!/bin/bash
+
+# Benchmarks a single pcc_client -> pcc_server transfer.
+# Generates a random input file of the given size, then for every server
+# mode, buffer size (used on both sides) and socket buffer size starts the
+# server, sends the file with pcc_client and checks the printable count
+# against tr -cd '[:print:]'. Then compares the client send modes (copy,
+# sendfile, splice, zerocopy) against the default server.
+# Writes one CSV line per run: server mode, client send mode, buffer size,
+# socket buffer size, bytes, best time of all runs, throughput and correctness.
+#
+# Usage: ./bench_transfer.sh [-o <csv file>] [-r <runs>] [-d <work dir>] [size]
+# size takes a K/M/G suffix, e.g. ./bench_transfer.sh 1G
+
+OUT=bench_transfer.csv
+RUNS=3
+WORK_DIR=/tmp/transfer_bench
+while getopts "o:r:d:" OPT; do
+    case $OPT in
+        o) OUT=$OPTARG ;;
+        r) RUNS=$OPTARG ;;
+        d) WORK_DIR=$OPTARG ;;
+        *) echo "Usage: ./bench_transfer.sh [-o <csv file>] [-r <runs>] [-d <work dir>] [size]"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+SIZE=${1:-256M}
+BUFFERS="1K 16K 256K 1M"
+SOCKET_BUFFERS="auto 4M"
+# server mode name and flags
+MODES=("loops:" "pool:-p" "threads:-t")
+SEND_MODES="copy sendfile splice zerocopy"
+SEND_BUFFER=256K
+
+bash build.sh 2> /dev/null || exit 1
+mkdir -p $WORK_DIR
+
+BYTES=$(numfmt --from=iec $SIZE)
+FILE=$WORK_DIR/input_$SIZE.bin
+if [ ! -f $FILE ] || [ $(stat -c %s $FILE) != $BYTES ]; then
+    head -c $BYTES /dev/urandom > $FILE
+fi
+EXPECTED=$(LC_ALL=C tr -cd '[:print:]' < $FILE | wc -c)
+cat $FILE > /dev/null # page cache
+
+# best wall time in ns of RUNS client runs, printable count of last run in $LAST
+best_time() {
+    BEST=""
+    for ((i=0; i<RUNS; i++)); do
+        START=$(date +%s%N)
+        LAST=$(./pcc_client "$@" | grep -o '^[0-9]*')
+        END=$(date +%s%N)
+        T=$((END - START))
+        if [ -z "$BEST" ] || [ $T -lt $BEST ]; then
+            BEST=$T
+        fi
+    done
+}
+
+# appends a CSV line - server mode, send mode, buffer, socket buffer, ns, count
+report() {
+    awk -v mode=$1 -v send=$2 -v buffer=$3 -v sockbuf=$4 -v ns=$5 -v count=$6 -v bytes=$BYTES -v expected=$EXPECTED 'BEGIN {
+        printf "%s,%s,%s,%s,%d,%.6f,%.1f,%d,%d,%s\n", mode, send, buffer, sockbuf, bytes, ns / 1e9,
+            (ns > 0) ? bytes / 1048576 / (ns / 1e9) : 0, count, expected,
+            (count == expected) ? "ok" : "MISMATCH" }' | tee -a $OUT
+}
+
+echo "mode,send_mode,buffer_size,socket_buffer_size,bytes,seconds,mb_per_s,printable,expected,correct" | tee $OUT
+for MODE in "${MODES[@]}"; do
+    NAME=${MODE%%:*}
+    FLAGS=${MODE#*:}
+    for BUFFER in $BUFFERS; do
+        for SOCKBUF in $SOCKET_BUFFERS; do
+            SOCKBUF_FLAG=""
+            [ $SOCKBUF != auto ] && SOCKBUF_FLAG="-s $SOCKBUF"
+            ./pcc_server $FLAGS -b $BUFFER $SOCKBUF_FLAG > /dev/null &
+            SERVER=$!
+            sleep 0.3
+            best_time -b $BUFFER $SOCKBUF_FLAG -m copy -i $FILE $BYTES
+            kill -INT $SERVER
+            wait $SERVER
+            report $NAME copy $BUFFER $SOCKBUF $BEST ${LAST:-0}
+        done
+    done
+done
+
+./pcc_server -b $SEND_BUFFER > /dev/null &
+SERVER=$!
+sleep 0.3
+for SEND in $SEND_MODES; do
+    best_time -b $SEND_BUFFER -m $SEND -i $FILE $BYTES
+    report loops $SEND $SEND_BUFFER auto $BEST ${LAST:-0}
+done
+kill -INT $SERVER
+wait $SERVER
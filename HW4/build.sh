@@ -1,4 +1,4 @@
 #!/bin/bash
 
-gcc -o pcc_client pcc_client.c
-gcc -o pcc_server pcc_server.c -lpthread
+gcc -o pcc_client pcc_client.c pcc_util.c
+gcc -o pcc_server pcc_server.c pcc_stats.c pcc_reactor.c pcc_pool.c pcc_util.c -lpthread
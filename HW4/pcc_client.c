@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -5,20 +6,57 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <string.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 
+#include "pcc_util.h"
+
 // consts
 #define SERVER_PORT 2233
 #define SERVER_ADDRESS "127.0.0.1"
 #define INPUT_FILE "/dev/urandom"
-#define BUFFER_SIZE 1024
+#define MESSAGE_SIZE 1024
+#define DEFAULT_BUFFER_SIZE (256*1024)
+#define OPTIONS "b:s:i:m:"
+#define ZEROCOPY_BUFFERS 4		// minimum buffers in flight while waiting for completions
+#define ZEROCOPY_IN_FLIGHT (4*1024*1024)	// minimum bytes in flight (pages are held until ACKed)
+
+// send modes
+#define SEND_AUTO -1			// sendfile for regular files, copy otherwise
+#define SEND_COPY 0				// read into buffer, write to socket
+#define SEND_SENDFILE 1			// sendfile from input file to socket
+#define SEND_SPLICE 2			// splice input into a pipe and pipe into socket
+#define SEND_ZEROCOPY 3			// read into buffer, send with MSG_ZEROCOPY
+#define NUM_SEND_MODES 4
+const char* SEND_MODE_NAMES[NUM_SEND_MODES] = {"copy", "sendfile", "splice", "zerocopy"};
 
 // error messages
 #define USAGE_ERROR "Number of bytes to transfer not provided\n"
+#define USAGE_MSG "Usage: pcc_client [-b <buffer size>] [-s <socket buffer size>] [-i <input file>]" \
+		" [-m <send mode>] <bytes>\n" \
+		"  -b  bytes sent to socket at once (default 256K)\n" \
+		"  -s  SO_SNDBUF/SO_RCVBUF of connection (default: kernel autotuning)\n" \
+		"  -i  input file (default /dev/urandom)\n" \
+		"  -m  copy, sendfile (regular files), splice or zerocopy (MSG_ZEROCOPY)\n" \
+		"      (default: sendfile for regular files, copy otherwise)\n"
+#define SEND_MODE_ERROR "Invalid send mode: %s\n"
+#define SENDFILE_ERROR "Error sending file: %s\n"
+#define PIPE_ERROR "Error creating pipe: %s\n"
+#define SPLICE_ERROR "Error splicing input to socket: %s\n"
+#define ZEROCOPY_ERROR "Error enabling zero copy: %s\n"
+#define ZEROCOPY_WAIT_ERROR "Error waiting for zero copy completion: %s\n"
+#define SIZE_ERROR "Invalid size: %s\n"
+#define ALLOCATION_ERROR "Allocation Error\n"
+#define SOCKET_BUFFER_ERROR "Error setting socket buffer size: %s\n"
+#define INPUT_EOF_ERROR "Input file ended before all bytes were sent\n"
 #define SOCKET_CREATE_ERROR "Error creating socket\n"
 #define CONNECT_ERROR "Connect Failed: %s\n"
 #define INPUT_OPEN_ERROR "Error opening input file: %s\n"
@@ -29,6 +67,22 @@
 // output messages
 #define OUTPUT_MSG "%lld printable characters out of %lld total characters\n"
 
+// global variables
+long long buffer_size = DEFAULT_BUFFER_SIZE;
+int socket_buffer_size = 0;		// 0 - leave to kernel autotuning
+int send_mode = SEND_AUTO;
+
+
+/*
+ * Returns send mode id of given name, -1 if not a valid name
+ */
+int parseSendMode(const char* name) {
+	for (int mode=0; mode < NUM_SEND_MODES; mode++)
+		if (strcmp(name, SEND_MODE_NAMES[mode]) == 0)
+			return mode;
+	return -1;
+}
+
 
 /*
  * Opens file (by filename) for reading
@@ -46,6 +100,7 @@ int openFile(const char* filename) {
 
 /*
  * Connects to server at given address and port
+ * Socket buffer sizes are set before connecting, so the TCP window scale matches
  * Returns socket file descriptor on success, -1 on failure
  */
 int connectToServer(const char* address, int port) {
@@ -56,6 +111,14 @@ int connectToServer(const char* address, int port) {
 		return -1;
 	}
 
+	if (socket_buffer_size && (
+			setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &socket_buffer_size, sizeof(int)) < 0 ||
+			setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &socket_buffer_size, sizeof(int)) < 0)) {
+		printf(SOCKET_BUFFER_ERROR, strerror(errno));
+		close(sockfd);
+		return -1;
+	}
+
 	// set connection parameters
 	struct sockaddr_in serv_addr;
 	memset(&serv_addr, '0', sizeof(serv_addr));
@@ -66,6 +129,7 @@ int connectToServer(const char* address, int port) {
 	// connect
 	if (connect(sockfd, (struct sockaddr*) &serv_addr, sizeof(serv_addr)) < 0) {
 		printf(CONNECT_ERROR, strerror(errno));
+		close(sockfd);
 		return -1;
 	}
 
@@ -73,6 +137,270 @@ int connectToServer(const char* address, int port) {
 }
 
 
+/*
+ * Writes all bytes of buffer to socket (retries partial writes)
+ * Returns 0 on success, -1 on failure
+ */
+int writeAll(int sockfd, const char* buffer, long long size) {
+	while (size > 0) {
+		long long written = write(sockfd, buffer, size);
+		if (written < 0) {
+			printf(SOCKET_WRITE_ERROR, strerror(errno));
+			return -1;
+		}
+		buffer += written;
+		size -= written;
+	}
+	return 0;
+}
+
+
+/*
+ * Reads from input into buffer - may return less than asked
+ * Returns number of bytes read, -1 on failure or end of input
+ */
+long long readInput(int inputfd, char* data, long long size) {
+	long long bytes_read = read(inputfd, data, size);
+	if (bytes_read <= 0) {
+		if (bytes_read < 0) printf(INPUT_READ_ERROR, strerror(errno));
+		else printf(INPUT_EOF_ERROR);
+		return -1;
+	}
+	return bytes_read;
+}
+
+
+/*
+ * Sends len bytes of input by reading them into a buffer and writing it to socket
+ * Returns 0 on success, -1 on failure
+ */
+int sendCopy(long long len, int inputfd, int sockfd) {
+	char* data = (char*) malloc(buffer_size);
+	if (!data) {
+		printf(ALLOCATION_ERROR);
+		return -1;
+	}
+	long long data_sent = 0;
+	while (data_sent < len) {
+		// do not overflow
+		long long to_send = len - data_sent;
+		if (to_send > buffer_size)
+			to_send = buffer_size;
+
+		long long bytes_read = readInput(inputfd, data, to_send);
+		if (bytes_read < 0 || writeAll(sockfd, data, bytes_read) < 0) {
+			free(data);
+			return -1;
+		}
+		data_sent += bytes_read;
+	}
+	free(data);
+	return 0;
+}
+
+
+/*
+ * Sends len bytes of input (a regular file, from its current offset) with
+ * sendfile - file pages go to the socket without passing through user space
+ * Returns 0 on success, -1 on failure
+ */
+int sendFile(long long len, int inputfd, int sockfd) {
+	long long data_sent = 0;
+	while (data_sent < len) {
+		long long to_send = len - data_sent;
+		if (to_send > buffer_size)
+			to_send = buffer_size;
+		long long sent = sendfile(sockfd, inputfd, NULL, to_send);
+		if (sent <= 0) {
+			if (sent < 0) printf(SENDFILE_ERROR, strerror(errno));
+			else printf(INPUT_EOF_ERROR);
+			return -1;
+		}
+		data_sent += sent;
+	}
+	return 0;
+}
+
+
+/*
+ * Sends len bytes of input through a pipe with splice - input pages are moved
+ * into the pipe and from the pipe into the socket without a user space copy.
+ * Works for inputs sendfile does not support (pipes, character devices).
+ * Returns 0 on success, -1 on failure
+ */
+int sendSplice(long long len, int inputfd, int sockfd) {
+	int pipefd[2];
+	if (pipe(pipefd) < 0) {
+		printf(PIPE_ERROR, strerror(errno));
+		return -1;
+	}
+	// larger pipe moves more per call - best effort, the default size also works
+	fcntl(pipefd[1], F_SETPIPE_SZ, (int) buffer_size);
+
+	int ret = 0;
+	long long data_sent = 0;
+	while (data_sent < len && ret == 0) {
+		long long to_send = len - data_sent;
+		if (to_send > buffer_size)
+			to_send = buffer_size;
+
+		// input -> pipe
+		long long in_pipe = splice(inputfd, NULL, pipefd[1], NULL, to_send, SPLICE_F_MOVE);
+		if (in_pipe <= 0) {
+			if (in_pipe < 0) printf(SPLICE_ERROR, strerror(errno));
+			else printf(INPUT_EOF_ERROR);
+			ret = -1;
+			break;
+		}
+
+		// pipe -> socket
+		data_sent += in_pipe;
+		while (in_pipe > 0) {
+			long long sent = splice(pipefd[0], NULL, sockfd, NULL, in_pipe,
+					SPLICE_F_MOVE | (data_sent < len ? SPLICE_F_MORE : 0));
+			if (sent <= 0) {
+				printf(SPLICE_ERROR, strerror(errno));
+				ret = -1;
+				break;
+			}
+			in_pipe -= sent;
+		}
+	}
+	close(pipefd[0]);
+	close(pipefd[1]);
+	return ret;
+}
+
+
+/*
+ * Waits until kernel reports MSG_ZEROCOPY sends with ids below target are done
+ * (their buffers may be reused). Completions are read from socket error queue.
+ * @param completed - number of sends known to be complete, updated
+ * Returns 0 on success, -1 on failure
+ */
+int waitZeroCopy(int sockfd, unsigned target, unsigned* completed) {
+	while (*completed < target) {
+		char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+		struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+		if (recvmsg(sockfd, &msg, MSG_ERRQUEUE) < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				printf(ZEROCOPY_WAIT_ERROR, strerror(errno));
+				return -1;
+			}
+			// nothing queued yet - error queue readiness is reported as POLLERR
+			struct pollfd pfd = {.fd = sockfd, .events = 0};
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+				printf(ZEROCOPY_WAIT_ERROR, strerror(errno));
+				return -1;
+			}
+			continue;
+		}
+
+		// notification covers the range of send ids [ee_info, ee_data]
+		for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			struct sock_extended_err* err = (struct sock_extended_err*) CMSG_DATA(cmsg);
+			if (err->ee_origin == SO_EE_ORIGIN_ZEROCOPY && err->ee_data + 1 > *completed)
+				*completed = err->ee_data + 1;
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * Sends len bytes of input with MSG_ZEROCOPY - the socket references the
+ * buffer pages instead of copying them. A buffer may only be refilled once
+ * the kernel reported its sends complete, which for TCP means acknowledged,
+ * so enough buffers for ZEROCOPY_IN_FLIGHT bytes (at least ZEROCOPY_BUFFERS)
+ * are rotated to keep reading while earlier sends are in flight.
+ * (On loopback the kernel still copies, so gains show only on real NICs.)
+ * Returns 0 on success, -1 on failure
+ */
+int sendZeroCopy(long long len, int inputfd, int sockfd) {
+	if (setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &(int){1}, sizeof(int)) < 0) {
+		printf(ZEROCOPY_ERROR, strerror(errno));
+		return -1;
+	}
+	int num_buffers = ZEROCOPY_IN_FLIGHT / buffer_size;
+	if (num_buffers < ZEROCOPY_BUFFERS)
+		num_buffers = ZEROCOPY_BUFFERS;
+	char* data = (char*) malloc(num_buffers * buffer_size);
+	unsigned* last_send = (unsigned*) calloc(num_buffers, sizeof(unsigned)); // sends using buffer are below this
+	if (!data || !last_send) {
+		printf(ALLOCATION_ERROR);
+		free(data);
+		free(last_send);
+		return -1;
+	}
+
+	int ret = 0;
+	unsigned num_sends = 0, completed = 0;		// each send call gets the next id
+	long long data_sent = 0;
+	for (int i=0; data_sent < len; i = (i + 1) % num_buffers) {
+		char* buffer = data + i * buffer_size;
+		if (waitZeroCopy(sockfd, last_send[i], &completed) < 0) {
+			ret = -1;
+			break;
+		}
+
+		long long to_send = len - data_sent;
+		if (to_send > buffer_size)
+			to_send = buffer_size;
+		long long bytes_read = readInput(inputfd, buffer, to_send);
+		if (bytes_read < 0) {
+			ret = -1;
+			break;
+		}
+
+		// send buffer - retry partial sends
+		for (long long offset = 0; offset < bytes_read; ) {
+			long long sent = send(sockfd, buffer + offset, bytes_read - offset, MSG_ZEROCOPY);
+			if (sent < 0) {
+				printf(SOCKET_WRITE_ERROR, strerror(errno));
+				ret = -1;
+				break;
+			}
+			offset += sent;
+			num_sends++;
+		}
+		if (ret < 0)
+			break;
+		last_send[i] = num_sends;
+		data_sent += bytes_read;
+	}
+
+	// buffers must not be freed while the kernel still references them
+	if (waitZeroCopy(sockfd, num_sends, &completed) < 0)
+		ret = -1;
+	free(data);
+	free(last_send);
+	return ret;
+}
+
+
+/*
+ * Sends len bytes of input to socket using send_mode
+ * Returns 0 on success, -1 on failure
+ */
+int sendData(long long len, int inputfd, int sockfd) {
+	int mode = send_mode;
+	if (mode == SEND_AUTO) {
+		struct stat st;
+		mode = (fstat(inputfd, &st) == 0 && S_ISREG(st.st_mode)) ? SEND_SENDFILE : SEND_COPY;
+	}
+	switch (mode) {
+	case SEND_SENDFILE:
+		return sendFile(len, inputfd, sockfd);
+	case SEND_SPLICE:
+		return sendSplice(len, inputfd, sockfd);
+	case SEND_ZEROCOPY:
+		return sendZeroCopy(len, inputfd, sockfd);
+	default:
+		return sendCopy(len, inputfd, sockfd);
+	}
+}
+
+
 /*
  * Reads len bytes from input file, sends them to server, and
  * receives from server the number of printable bytes sent.
@@ -82,13 +410,14 @@ int connectToServer(const char* address, int port) {
  *   SERVER -> CLIENT: 'THANKS'			prevents data overflowing into len
  *   CLIENT -> SERVER: data 			in chunks
  *   SERVER -> CLIENT: num printable
+ * Data is sent buffer_size bytes at a time, using send_mode
  * Returns number of printable bytes on success, -1 on failure
  */
 long long transaction(long long len, int inputfd, int sockfd) {
-	char buffer[BUFFER_SIZE];
+	char buffer[MESSAGE_SIZE];
 
 	// wait for server to say HI
-	if (read(sockfd, buffer, BUFFER_SIZE) < 0) {
+	if (read(sockfd, buffer, MESSAGE_SIZE) < 0) {
 		printf(SOCKET_READ_ERROR, strerror(errno));
 		return -1;
 	}
@@ -101,38 +430,22 @@ long long transaction(long long len, int inputfd, int sockfd) {
 	}
 
 	// wait for server to say THANKS
-	if (read(sockfd, buffer, BUFFER_SIZE) < 0) {
+	if (read(sockfd, buffer, MESSAGE_SIZE) < 0) {
 		printf(SOCKET_READ_ERROR, strerror(errno));
 		return -1;
 	}
 
 	// read data from file and send to server
-	int buffer_size = BUFFER_SIZE;
-	long long data_sent = 0;
-	while (data_sent < len) {
-		// do not overflow
-		if (buffer_size > len - data_sent)
-			buffer_size = len - data_sent;
-
-		// read from input file
-		if (read(inputfd, buffer, buffer_size) < 0) {
-			printf(INPUT_READ_ERROR, strerror(errno));
-			return -1;
-		}
-
-		// write to socket
-		if (write(sockfd, buffer, buffer_size) < 0) {
-			printf(SOCKET_WRITE_ERROR, strerror(errno));
-			return -1;
-		}
-		data_sent += buffer_size;
-	}
+	if (sendData(len, inputfd, sockfd) < 0)
+		return -1;
 
 	// get number of characters from server
-	if (read(sockfd, buffer, BUFFER_SIZE) < 0) {
+	long long message_len = read(sockfd, buffer, MESSAGE_SIZE - 1);
+	if (message_len < 0) {
 		printf(SOCKET_READ_ERROR, strerror(errno));
 		return -1;
 	}
+	buffer[message_len] = '\0';
 
 	return atoll(buffer);
 }
@@ -140,19 +453,53 @@ long long transaction(long long len, int inputfd, int sockfd) {
 
 /*
  * 1. Gets number of characters to send to server as input
- * 2. Reads characters from /dev/urandom and sends them to server
+ * 2. Reads characters from /dev/urandom (or -i input file) and sends them to server
  * 3. Receives number of printable characters from server and prints it
  */
 int main (int argc, char* argv[]) {
-	if (argc < 2) {
+	const char* input_file = INPUT_FILE;
+	int opt;
+	while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+		switch (opt) {
+		case 'b':
+			buffer_size = parseSize(optarg);
+			if (buffer_size <= 0) {
+				printf(SIZE_ERROR, optarg);
+				return -1;
+			}
+			break;
+		case 's':
+			socket_buffer_size = parseSize(optarg);
+			if (socket_buffer_size <= 0) {
+				printf(SIZE_ERROR, optarg);
+				return -1;
+			}
+			break;
+		case 'i':
+			input_file = optarg;
+			break;
+		case 'm':
+			send_mode = parseSendMode(optarg);
+			if (send_mode < 0) {
+				printf(SEND_MODE_ERROR, optarg);
+				return -1;
+			}
+			break;
+		default:
+			printf(USAGE_MSG);
+			return -1;
+		}
+	}
+	if (optind >= argc) {
 		printf(USAGE_ERROR);
+		printf(USAGE_MSG);
 		return -1;
 	}
-	long long len = atoll(argv[1]);
+	long long len = atoll(argv[optind]);
 
 	// open connection and file
 	int sockfd = connectToServer(SERVER_ADDRESS, SERVER_PORT);
-	int inputfd = openFile(INPUT_FILE);
+	int inputfd = openFile(input_file);
 
 	// communicate with server and print output on success
 	if (sockfd != -1 && inputfd != -1) {
@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+#include "pcc_pool.h"
+#include "pcc_stats.h"
+
+// consts
+#define CACHE_LINE_SIZE 64
+
+// error messages
+#define ACCEPT_ERROR "Accept failed: %s\n"
+#define THREAD_CREATE_ERROR "Thread creation failed\n"
+#define ALLOCATION_ERROR "Allocation Error\n"
+
+// output messages
+#define SERVER_DOWN_MSG "SERVER IS DOWN, Waiting for %d connections to finish\n"
+
+/*
+ * Bounded single producer / multiple consumer queue of connections.
+ * Only the accepting thread fills it (tail), any worker may take from it
+ * (head, advanced with compare-and-swap).
+ */
+typedef struct workQueue {
+	unsigned long head __attribute__((aligned(CACHE_LINE_SIZE)));
+	unsigned long tail __attribute__((aligned(CACHE_LINE_SIZE)));
+	int slots[POOL_QUEUE_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+} workQueue;
+
+typedef struct poolWorker {
+	pthread_t thread;
+	int id;						// also the worker's stats shard
+} poolWorker;
+
+// global variables
+workQueue* QUEUES = NULL;
+int num_queues = 0;
+sem_t pending;					// connections in queues (+ stop tokens)
+sem_t free_slots;				// free slots in all queues
+int stopping = 0;				// set once no more connections are queued
+int active_connections = 0;		// queued or being served
+transactionHandler handle_transaction = NULL;
+
+
+/*
+ * Adds connection to queue (accepting thread only)
+ * Returns 1 on success, 0 if queue is full
+ */
+int pushConnection(workQueue* queue, int connfd) {
+	unsigned long tail = queue->tail;
+	if (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) >= POOL_QUEUE_SIZE)
+		return 0;
+	__atomic_store_n(&queue->slots[tail % POOL_QUEUE_SIZE], connfd, __ATOMIC_RELAXED);
+	__atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+
+/*
+ * Takes connection from queue (any worker)
+ * Returns 1 and sets connfd on success, 0 if queue is empty
+ */
+int popConnection(workQueue* queue, int* connfd) {
+	unsigned long head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	while (1) {
+		if (head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE))
+			return 0;
+		// the slot can only be refilled after head moved on, in which case the CAS fails
+		int fd = __atomic_load_n(&queue->slots[head % POOL_QUEUE_SIZE], __ATOMIC_RELAXED);
+		if (__atomic_compare_exchange_n(&queue->head, &head, head + 1, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			*connfd = fd;
+			return 1;
+		}
+	}
+}
+
+
+/*
+ * Takes connection for worker - from its own queue first, then steals from others.
+ * Called after taking a pending token, so a connection is guaranteed to exist
+ * unless the pool is stopping.
+ * Returns connection file descriptor, -1 if pool is stopping and queues are empty
+ */
+int takeConnection(int id) {
+	int connfd;
+	while (1) {
+		for (int i=0; i < num_queues; i++)
+			if (popConnection(&QUEUES[(id + i) % num_queues], &connfd))
+				return connfd;
+		if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+			return -1;
+	}
+}
+
+
+/*
+ * Worker thread - serves connections until the pool is stopped and drained
+ */
+void* poolWorkerThread(void* worker_ptr) {
+	poolWorker* worker = (poolWorker*) worker_ptr;
+	while (1) {
+		while (sem_wait(&pending) != 0 && errno == EINTR);
+		int connfd = takeConnection(worker->id);
+		if (connfd < 0)
+			break;
+		sem_post(&free_slots);
+
+		// process connection
+		long long stats[NUM_CHARS] = {0};
+		long long bytes_read = handle_transaction(connfd, stats);
+		close(connfd);
+		if (bytes_read >= 0)
+			addStats(worker->id, stats, bytes_read);
+		__atomic_sub_fetch(&active_connections, 1, __ATOMIC_RELAXED);
+	}
+	pthread_exit(NULL);
+}
+
+
+/*
+ * Starts workers, accepts connections until SIGINT and drains queues
+ */
+int runPool(int listenfd, int num_workers, transactionHandler handler) {
+	int ret = 0;
+	handle_transaction = handler;
+	num_queues = num_workers;
+	poolWorker* workers = (poolWorker*) calloc(num_workers, sizeof(poolWorker));
+	if (!workers || posix_memalign((void**) &QUEUES, CACHE_LINE_SIZE, num_workers * sizeof(workQueue))) {
+		printf(ALLOCATION_ERROR);
+		free(workers);
+		close(listenfd);
+		return -1;
+	}
+	memset(QUEUES, 0, num_workers * sizeof(workQueue));
+	sem_init(&pending, 0, 0);
+	sem_init(&free_slots, 0, num_workers * POOL_QUEUE_SIZE);
+
+	// start workers with SIGINT blocked - accept in this thread gets it
+	sigset_t block_set, old_set;
+	sigemptyset(&block_set);
+	sigaddset(&block_set, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &block_set, &old_set);
+	int started = 0;
+	for (; started < num_workers; started++) {
+		workers[started].id = started;
+		if (pthread_create(&workers[started].thread, NULL, poolWorkerThread, &workers[started])) {
+			printf(THREAD_CREATE_ERROR);
+			ret = -1;
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+	// accept loop - breaks on SIGINT or error
+	int next_queue = 0, interrupted = 0;
+	while (started == num_workers && !interrupted) {
+		int connfd = accept(listenfd, NULL, NULL);
+		if (connfd < 0) {
+			if (errno != EINTR) { // do not print error on SIGINT
+				printf(ACCEPT_ERROR, strerror(errno));
+				ret = -1;
+			}
+			break;
+		}
+
+		// wait for a free slot - SIGINT while waiting stops after this connection
+		while (sem_wait(&free_slots) != 0)
+			interrupted = 1;
+
+		// hand round-robin to a worker queue that has room
+		while (!pushConnection(&QUEUES[next_queue], connfd))
+			next_queue = (next_queue + 1) % num_queues;
+		next_queue = (next_queue + 1) % num_queues;
+		__atomic_add_fetch(&active_connections, 1, __ATOMIC_RELAXED);
+		sem_post(&pending);
+	}
+	close(listenfd);
+
+	// let workers drain queues and stop
+	printf(SERVER_DOWN_MSG, __atomic_load_n(&active_connections, __ATOMIC_RELAXED));
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	for (int i=0; i < started; i++)
+		sem_post(&pending);
+	for (int i=0; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	// close connections left without workers (only if some failed to start)
+	int connfd;
+	for (int i=0; i < num_queues; i++)
+		while (popConnection(&QUEUES[i], &connfd))
+			close(connfd);
+
+	sem_destroy(&pending);
+	sem_destroy(&free_slots);
+	free(QUEUES);
+	free(workers);
+	return ret;
+}
@@ -0,0 +1,31 @@
+#ifndef PCC_POOL_H_
+#define PCC_POOL_H_
+
+// consts
+#define POOL_QUEUE_SIZE 1024	// pending connections per worker (power of 2)
+
+/*
+ * Handles a single client connection (does not close it)
+ * @param stats - per character counters of this transaction
+ * @return number of bytes read on success, -1 on failure
+ */
+typedef long long (*transactionHandler)(int connfd, long long* stats);
+
+/*
+ * Serves clients with a fixed pool of worker threads.
+ * The calling thread accepts connections and hands them round-robin to
+ * per-worker lock-free queues. A worker serves its own queue first and steals
+ * from the other queues when it is empty, so a worker stuck on a long
+ * transaction does not hold back the connections queued behind it.
+ * At most num_workers * POOL_QUEUE_SIZE connections wait in the queues, the
+ * rest wait in the listener backlog.
+ * Runs until SIGINT, then stops accepting and lets queued and open connections
+ * finish. Each worker adds to its own global statistics shard.
+ * @param listenfd - listening socket, closed when done
+ * @param num_workers - number of worker threads
+ * @param handler - called by workers for each connection
+ * @return 0 on success, -1 on failure
+ */
+int runPool(int listenfd, int num_workers, transactionHandler handler);
+
+#endif /* PCC_POOL_H_ */
@@ -0,0 +1,405 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "pcc_reactor.h"
+#include "pcc_stats.h"
+
+// error messages
+#define EPOLL_CREATE_ERROR "Error creating epoll instance: %s\n"
+#define EPOLL_CTL_ERROR "Error registering with epoll: %s\n"
+#define EPOLL_WAIT_ERROR "Error waiting for events: %s\n"
+#define EVENTFD_ERROR "Error creating stop event: %s\n"
+#define NONBLOCK_ERROR "Error setting socket non-blocking: %s\n"
+#define SOCKET_READ_ERROR "Error reading from socket: %s\n"
+#define SOCKET_WRITE_ERROR "Error writing to socket: %s\n"
+#define ACCEPT_ERROR "Accept failed: %s\n"
+#define THREAD_CREATE_ERROR "Thread creation failed\n"
+#define ALLOCATION_ERROR "Allocation Error\n"
+
+// output messages
+#define SERVER_DOWN_MSG "SERVER IS DOWN, Waiting for %d connections to finish\n"
+
+// connection states - in protocol order (see transaction in pcc_server.c)
+typedef enum {SEND_HI, READ_LEN, SEND_THANKS, READ_DATA, SEND_COUNT} connectionState;
+
+typedef struct connection {
+	int connfd;
+	connectionState state;
+	char header[HEADER_SIZE];	// message being sent or length being read
+	int header_len;
+	int header_sent;
+	long long len;
+	long long total_bytes;
+	long long printable_bytes;
+	long long stats[NUM_CHARS];
+	struct connection* prev;	// open connections list of the loop
+	struct connection* next;
+	struct connection* ready_next;	// ready list of the loop
+	int ready;					// on ready list - has data left after its read budget
+} connection;
+
+typedef struct eventLoop {
+	pthread_t thread;
+	int id;						// also the loop's stats shard
+	int listenfd;				// -1 once the loop stopped accepting
+	int epollfd;
+	int num_connections;
+	int failed;
+	connection* connections;
+	connection* ready_head;		// connections to serve again before waiting
+	connection* ready_tail;
+} eventLoop;
+
+// global variables
+int stopfd = -1;				// readable once SIGINT was received
+long long loop_buffer_size = 0;	// size of each loop's read buffer
+
+
+/*
+ * Sets message to be sent to client and moves connection to the sending state
+ */
+void setMessage(connection* conn, connectionState state, const char* message) {
+	conn->state = state;
+	conn->header_len = snprintf(conn->header, HEADER_SIZE, "%s", message);
+	conn->header_sent = 0;
+}
+
+
+/*
+ * Runs connection state machine until the socket would block, or until it
+ * read READ_BUDGET buffers of data - so one bulk sender can not hold the loop.
+ * The read buffer is shared by all connections of the loop, since data is
+ * counted as soon as it is read.
+ * Returns 0 if waiting for socket, 1 if transaction is done, -1 on failure,
+ * 2 if the read budget ran out (socket may still have data)
+ */
+int advanceConnection(connection* conn, char* buffer) {
+	ssize_t n;
+	int reads = 0;
+	while (1) {
+		switch (conn->state) {
+		case SEND_HI:
+		case SEND_THANKS:
+		case SEND_COUNT:
+			n = send(conn->connfd, conn->header + conn->header_sent,
+					conn->header_len - conn->header_sent, MSG_NOSIGNAL);
+			if (n < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return 0;
+				printf(SOCKET_WRITE_ERROR, strerror(errno));
+				return -1;
+			}
+			conn->header_sent += n;
+			if (conn->header_sent < conn->header_len)
+				break;
+			if (conn->state == SEND_COUNT)
+				return 1;
+			conn->state = conn->state == SEND_HI ? READ_LEN : READ_DATA;
+			conn->header_len = 0;
+			break;
+
+		case READ_LEN:
+			n = read(conn->connfd, conn->header + conn->header_len,
+					HEADER_SIZE - 1 - conn->header_len);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				return 0;
+			if (n <= 0) {
+				printf(SOCKET_READ_ERROR, strerror(errno));
+				return -1;
+			}
+			conn->header_len += n;
+			conn->header[conn->header_len] = '\0';
+			// client ends length with a space - wait for the rest if it was split
+			if (!strchr(conn->header, ' ') && conn->header_len < HEADER_SIZE - 1)
+				break;
+			conn->len = atoll(conn->header);
+			setMessage(conn, SEND_THANKS, "THANKS");
+			break;
+
+		case READ_DATA:
+			if (conn->total_bytes >= conn->len) {
+				char message[HEADER_SIZE];
+				sprintf(message, "%lld ", conn->printable_bytes);
+				setMessage(conn, SEND_COUNT, message);
+				break;
+			}
+			if (reads++ == READ_BUDGET)
+				return 2;
+			long long to_read = conn->len - conn->total_bytes;
+			n = read(conn->connfd, buffer, to_read < loop_buffer_size ? to_read : loop_buffer_size);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				return 0;
+			if (n <= 0) {
+				printf(SOCKET_READ_ERROR, strerror(errno));
+				return -1;
+			}
+			conn->printable_bytes += countPrintable(buffer, n, conn->stats);
+			conn->total_bytes += n;
+			break;
+		}
+	}
+}
+
+
+/*
+ * Closes connection, and on successful transaction adds its stats to loop shard
+ */
+void closeConnection(eventLoop* loop, connection* conn, int success) {
+	if (success)
+		addStats(loop->id, conn->stats, conn->total_bytes);
+	// closing the socket also removes it from epoll
+	close(conn->connfd);
+	if (conn->prev) conn->prev->next = conn->next;
+	else loop->connections = conn->next;
+	if (conn->next) conn->next->prev = conn->prev;
+	free(conn);
+	__atomic_sub_fetch(&loop->num_connections, 1, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Adds connection to the tail of the loop ready list
+ */
+void pushReady(eventLoop* loop, connection* conn) {
+	conn->ready = 1;
+	conn->ready_next = NULL;
+	if (loop->ready_tail) loop->ready_tail->ready_next = conn;
+	else loop->ready_head = conn;
+	loop->ready_tail = conn;
+}
+
+
+/*
+ * Advances connection and closes it when done, or queues it on the ready
+ * list if it ran out of read budget
+ */
+void serveConnection(eventLoop* loop, connection* conn, char* buffer) {
+	int status = advanceConnection(conn, buffer);
+	if (status == 2)
+		pushReady(loop, conn);
+	else if (status != 0)
+		closeConnection(loop, conn, status == 1);
+}
+
+
+/*
+ * Serves every connection on the ready list once - connections that use up
+ * their budget again go back to the tail, for the next round
+ */
+void serveReady(eventLoop* loop, char* buffer) {
+	connection* conn = loop->ready_head;
+	loop->ready_head = loop->ready_tail = NULL;
+	while (conn) {
+		connection* next = conn->ready_next;
+		conn->ready = 0;
+		serveConnection(loop, conn, buffer);
+		conn = next;
+	}
+}
+
+
+/*
+ * Accepts all pending connections (listener is edge-triggered)
+ * and registers them with the loop
+ */
+void acceptConnections(eventLoop* loop) {
+	while (1) {
+		int connfd = accept4(loop->listenfd, NULL, NULL, SOCK_NONBLOCK);
+		if (connfd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				printf(ACCEPT_ERROR, strerror(errno));
+			return;
+		}
+
+		connection* conn = (connection*) calloc(1, sizeof(connection));
+		if (!conn) {
+			printf(ALLOCATION_ERROR);
+			close(connfd);
+			continue;
+		}
+		conn->connfd = connfd;
+		setMessage(conn, SEND_HI, "HI");
+
+		// registering a writable socket raises the first event, which sends HI
+		struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLET, .data.ptr = conn};
+		if (epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, connfd, &event) < 0) {
+			printf(EPOLL_CTL_ERROR, strerror(errno));
+			close(connfd);
+			free(conn);
+			continue;
+		}
+		conn->next = loop->connections;
+		if (conn->next) conn->next->prev = conn;
+		loop->connections = conn;
+		__atomic_add_fetch(&loop->num_connections, 1, __ATOMIC_RELAXED);
+	}
+}
+
+
+/*
+ * Closes loop listener and stops listening to stop event
+ */
+void stopAccepting(eventLoop* loop) {
+	if (loop->listenfd == -1)
+		return;
+	epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, stopfd, NULL);
+	close(loop->listenfd);
+	loop->listenfd = -1;
+}
+
+
+/*
+ * Event loop thread - serves connections accepted on its listener until
+ * stop event is raised and all its connections are done
+ */
+void* eventLoopThread(void* loop_ptr) {
+	eventLoop* loop = (eventLoop*) loop_ptr;
+	struct epoll_event events[MAX_EVENTS];
+	char* buffer = (char*) malloc(loop_buffer_size);
+	if (!buffer) {
+		printf(ALLOCATION_ERROR);
+		loop->failed = 1;
+	}
+
+	while (buffer && (loop->listenfd != -1 || loop->connections)) {
+		// only poll while connections are waiting on the ready list
+		int num_events = epoll_wait(loop->epollfd, events, MAX_EVENTS, loop->ready_head ? 0 : -1);
+		if (num_events < 0) {
+			if (errno == EINTR)
+				continue;
+			printf(EPOLL_WAIT_ERROR, strerror(errno));
+			loop->failed = 1;
+			break;
+		}
+
+		for (int i=0; i < num_events; i++) {
+			void* ptr = events[i].data.ptr;
+			if (ptr == NULL)
+				stopAccepting(loop);
+			else if (ptr == loop) {
+				if (loop->listenfd != -1)
+					acceptConnections(loop);
+			}
+			else {
+				// a connection on the ready list is served with it
+				connection* conn = (connection*) ptr;
+				if (!conn->ready)
+					serveConnection(loop, conn, buffer);
+			}
+		}
+		serveReady(loop, buffer);
+	}
+
+	// drop whatever is left after a failure
+	stopAccepting(loop);
+	while (loop->connections)
+		closeConnection(loop, loop->connections, 0);
+	free(buffer);
+	pthread_exit(NULL);
+}
+
+
+/*
+ * Creates loop epoll instance and registers listener and stop event with it
+ * Returns 0 on success, -1 on failure
+ */
+int setupLoop(eventLoop* loop, int listenfd) {
+	loop->listenfd = listenfd;
+	if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK) < 0) {
+		printf(NONBLOCK_ERROR, strerror(errno));
+		return -1;
+	}
+	loop->epollfd = epoll_create1(0);
+	if (loop->epollfd < 0) {
+		printf(EPOLL_CREATE_ERROR, strerror(errno));
+		return -1;
+	}
+
+	// listener is edge-triggered, stop event is level-triggered so it wakes all loops
+	struct epoll_event listen_event = {.events = EPOLLIN | EPOLLET, .data.ptr = loop};
+	struct epoll_event stop_event = {.events = EPOLLIN, .data.ptr = NULL};
+	if (epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, listenfd, &listen_event) < 0 ||
+			epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, stopfd, &stop_event) < 0) {
+		printf(EPOLL_CTL_ERROR, strerror(errno));
+		close(loop->epollfd);
+		return -1;
+	}
+	return 0;
+}
+
+
+/*
+ * Starts event loops, waits for SIGINT and stops loops
+ */
+int runReactor(int* listenfds, int num_loops, long long buffer_size) {
+	int ret = 0;
+	loop_buffer_size = buffer_size;
+	stopfd = eventfd(0, EFD_NONBLOCK);
+	eventLoop* loops = (eventLoop*) calloc(num_loops, sizeof(eventLoop));
+	if (stopfd < 0 || !loops) {
+		if (stopfd < 0) printf(EVENTFD_ERROR, strerror(errno));
+		else printf(ALLOCATION_ERROR);
+		for (int i=0; i < num_loops; i++)
+			close(listenfds[i]);
+		free(loops);
+		if (stopfd >= 0) close(stopfd);
+		return -1;
+	}
+
+	// block SIGINT in loop threads - only this thread waits for it
+	sigset_t block_set, old_set;
+	sigemptyset(&block_set);
+	sigaddset(&block_set, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &block_set, &old_set);
+
+	// start loops
+	int started = 0;
+	for (; started < num_loops; started++) {
+		loops[started].id = started;
+		if (setupLoop(&loops[started], listenfds[started]) != 0)
+			break;
+		if (pthread_create(&loops[started].thread, NULL, eventLoopThread, &loops[started])) {
+			printf(THREAD_CREATE_ERROR);
+			close(loops[started].epollfd);
+			break;
+		}
+	}
+	for (int i=started; i < num_loops; i++)
+		close(listenfds[i]);
+
+	// wait for SIGINT unless some loop failed to start
+	if (started == num_loops)
+		sigsuspend(&old_set);
+	else
+		ret = -1;
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+	// stop accepting and wait for open connections
+	int num_connections = 0;
+	for (int i=0; i < started; i++)
+		num_connections += __atomic_load_n(&loops[i].num_connections, __ATOMIC_RELAXED);
+	printf(SERVER_DOWN_MSG, num_connections);
+	eventfd_write(stopfd, 1);
+	for (int i=0; i < started; i++) {
+		pthread_join(loops[i].thread, NULL);
+		close(loops[i].epollfd);
+		if (loops[i].failed)
+			ret = -1;
+	}
+
+	close(stopfd);
+	free(loops);
+	return ret;
+}
@@ -0,0 +1,24 @@
+#ifndef PCC_REACTOR_H_
+#define PCC_REACTOR_H_
+
+// consts
+#define MAX_EVENTS 256
+#define HEADER_SIZE 32
+#define READ_BUDGET 4		// buffers read from a connection before serving others
+
+/*
+ * Serves clients with one edge-triggered epoll event loop per listener.
+ * Each loop runs in its own thread and owns its listener, which should be
+ * bound with SO_REUSEPORT so the kernel spreads new connections between loops.
+ * A connection reads at most READ_BUDGET buffers per turn, then waits for
+ * the loop's other ready connections to have theirs.
+ * Blocks until SIGINT, then stops accepting and lets open connections finish.
+ * Each loop adds to its own global statistics shard.
+ * @param listenfds - listening sockets, one per loop
+ * @param num_loops - number of event loops
+ * @param buffer_size - bytes read from a connection at once
+ * @return 0 on success, -1 on failure
+ */
+int runReactor(int* listenfds, int num_loops, long long buffer_size);
+
+#endif /* PCC_REACTOR_H_ */
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -6,49 +7,72 @@
 #include <string.h>
 #include <ctype.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <signal.h>
+#include <sched.h>
+#include <getopt.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include "pcc_stats.h"
+#include "pcc_reactor.h"
+#include "pcc_pool.h"
+#include "pcc_util.h"
+
 // consts
 #define SERVER_PORT 2233
-#define BUFFER_SIZE 1024
+#define MESSAGE_SIZE 1024
+#define DEFAULT_BUFFER_SIZE (256*1024)
 #define NUM_LISTENERS 10
-#define NUM_CHARS 128
+#define MAX_NUM_LOOPS 256
+#define MAX_NUM_WORKERS 1024
+#define OPTIONS "tl:pw:b:s:"
 
 // error messages
+#define USAGE_ERROR "Usage: pcc_server [-t | -p [-w <workers>] | -l <event loops>]" \
+		" [-b <buffer size>] [-s <socket buffer size>]\n" \
+		"  -t  thread per connection instead of event loops\n" \
+		"  -p  fixed worker pool instead of event loops\n" \
+		"  -b  bytes read from socket at once (default 256K)\n" \
+		"  -s  SO_RCVBUF/SO_SNDBUF of connections (default: kernel autotuning)\n"
 #define SIG_REGISTER_ERROR "Error registering signal handle: %s\n"
 #define SOCKET_CREATE_ERROR "Error creating socket\n"
 #define SOCKET_REUSE_ERROR "Error setting socket reuse\n"
+#define SOCKET_BUFFER_ERROR "Error setting socket buffer size: %s\n"
 #define SOCKET_READ_ERROR "Error reading from socket: %s\n"
 #define SOCKET_WRITE_ERROR "Error writing to socket: %s\n"
 #define BIND_ERROR "Bind failed: %s\n"
 #define LISTEN_ERROR "Listen failed: %s\n"
 #define ACCEPT_ERROR "Accept failed: %s\n"
+#define LOOPS_ERROR "Invalid number of event loops: %s\n"
+#define WORKERS_ERROR "Invalid number of workers: %s\n"
+#define SIZE_ERROR "Invalid size: %s\n"
 #define THREAD_CREATE_ERROR "Thread creation failed\n"
 #define ALLOCATION_ERROR "Allocation Error\n"
 
 // output messages
 #define SERVER_UP_MSG "SERVER IS UP\n"
 #define SERVER_DOWN_MSG "SERVER IS DOWN, Waiting for %d threads to finish\n"
-#define STATS_COUNTER_MSG "Total bytes read: %lld\n"
-#define STATS_HEADER_MSG "CHAR\tSTATS\n"
-#define STATS_DATA_MSG "%c\t%lld\n"
 
 // global variables
-pthread_mutex_t lock;
-pthread_cond_t counter_cv;
-long long global_stats[NUM_CHARS] = {0};
-long long global_bytes_read = 0;
-int thread_counter = 0;
+long long buffer_size = DEFAULT_BUFFER_SIZE;
+int socket_buffer_size = 0;		// 0 - leave to kernel autotuning
+int thread_counter = 0;			// running client threads, updated atomically
+sem_t threads_done;				// posted by each client thread when done
+int next_shard = 0;				// stats shard of next client thread, updated atomically
 
 
 /*
  * Sets up listener socket to bind given port
+ * With reuse_port several listeners can bind the same port and the kernel
+ * balances incoming connections between them
+ * Socket buffer sizes are set on the listener (before listen, so the TCP
+ * window scale matches) and inherited by accepted connections
  * Returns socket fil descriptor on success, -1 on failure
  */
-int setupListener(int port) {
+int setupListener(int port, int reuse_port, int backlog) {
 	// create socket
 	int listenfd = socket(AF_INET, SOCK_STREAM, 0);
 	if (listenfd < 0) {
@@ -61,6 +85,18 @@ int setupListener(int port) {
 		close(listenfd);
 		return -1;
 	}
+	if (reuse_port && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) < 0) {
+		printf(SOCKET_REUSE_ERROR);
+		close(listenfd);
+		return -1;
+	}
+	if (socket_buffer_size && (
+			setsockopt(listenfd, SOL_SOCKET, SO_RCVBUF, &socket_buffer_size, sizeof(int)) < 0 ||
+			setsockopt(listenfd, SOL_SOCKET, SO_SNDBUF, &socket_buffer_size, sizeof(int)) < 0)) {
+		printf(SOCKET_BUFFER_ERROR, strerror(errno));
+		close(listenfd);
+		return -1;
+	}
 
 	// set connection parameters
 	struct sockaddr_in serv_addr;
@@ -77,7 +113,7 @@ int setupListener(int port) {
 	}
 
 	// listen
-	if(listen(listenfd, NUM_LISTENERS) != 0) {
+	if(listen(listenfd, backlog) != 0) {
 		printf(LISTEN_ERROR, strerror(errno));
 		close(listenfd);
 		return -1;
@@ -97,11 +133,13 @@ int setupListener(int port) {
  *   SERVER -> CLIENT: 'THANKS'			prevents data overflowing into len
  *   CLIENT -> SERVER: data 			in chunks
  *   SERVER -> CLIENT: num printable
- * Returns number of printable bytes on success, -1 on failure
+ * Data is received buffer_size bytes at a time with MSG_WAITALL, so every
+ * receive returns a full buffer instead of whatever arrived so far
+ * Returns number of bytes read on success, -1 on failure
  * Updates stats (number of appearances of each printable character)
  */
 long long transaction(int connfd, long long *stats) {
-	char buffer[BUFFER_SIZE];
+	char buffer[MESSAGE_SIZE];
 	long long len, bytes_read, total_bytes = 0, printable_bytes = 0;
 
 	// send HI to client to say server is ready
@@ -112,8 +150,11 @@ long long transaction(int connfd, long long *stats) {
 	}
 
 	// get length from client
-	if (read(connfd, buffer, BUFFER_SIZE) > 0)
+	long long message_len = read(connfd, buffer, MESSAGE_SIZE - 1);
+	if (message_len > 0) {
+		buffer[message_len] = '\0';
 		len = atoll(buffer);
+	}
 	else {
 		printf(SOCKET_READ_ERROR, strerror(errno));
 		return -1;
@@ -127,21 +168,24 @@ long long transaction(int connfd, long long *stats) {
 	}
 
 	// read data from client and count printable bytes
+	char* data = (char*) malloc(buffer_size);
+	if (!data) {
+		printf(ALLOCATION_ERROR);
+		return -1;
+	}
 	while (total_bytes < len) {
-		bytes_read = read(connfd, buffer, BUFFER_SIZE);
+		long long to_read = len - total_bytes;
+		bytes_read = recv(connfd, data, to_read < buffer_size ? to_read : buffer_size, MSG_WAITALL);
 		if (bytes_read <= 0) {
 			printf(SOCKET_READ_ERROR, strerror(errno));
+			free(data);
 			return -1;
 		}
 		// count printable and update stats
-		for (int i=0; i < bytes_read; i++) {
-			if (isprint(buffer[i])) {
-				printable_bytes++;
-				stats[(int) buffer[i]]++;
-			}
-		}
+		printable_bytes += countPrintable(data, bytes_read, stats);
 		total_bytes += bytes_read;
 	}
+	free(data);
 
 	// write number of printable bytes to client
 	sprintf(buffer,"%lld ",printable_bytes);
@@ -155,16 +199,14 @@ long long transaction(int connfd, long long *stats) {
 
 /*
  * Client handling thread - handles connection and updates stats
- * On start raises the number of threads counter and when done lowers it
- * and sends signal to counter conditional variable.
- * On successful transaction with client updates global stats
+ * The number of threads counter is raised before the thread is created
+ * (so it is never missed on shutdown), when done the thread lowers it
+ * and posts threads_done semaphore.
+ * On successful transaction with client updates global stats shard
+ * (handed out round robin as transactions finish, so concurrent updates
+ * share a shard only when more than NUM_STATS_SHARDS finish together)
  */
 void* handleClient(void *connfd_ptr) {
-	// raise thread counter
-	pthread_mutex_lock(&lock);
-	thread_counter++;
-	pthread_mutex_unlock(&lock);
-
 	// process connection
 	long long stats[NUM_CHARS] = {0};
 	int connfd = *((int*) connfd_ptr);
@@ -173,19 +215,12 @@ void* handleClient(void *connfd_ptr) {
 	close(connfd);
 
 	// update global stats
-	if (bytes_read >= 0) {
-		pthread_mutex_lock(&lock);
-		for (int i=0; i<NUM_CHARS; i++)
-			global_stats[i] += stats[i];
-		global_bytes_read += bytes_read;
-		pthread_mutex_unlock(&lock);
-	}
+	if (bytes_read >= 0)
+		addStats(__atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED), stats, bytes_read);
 
 	// lower thread counter and signal thread is done
-	pthread_mutex_lock(&lock);
-	thread_counter--;
-	pthread_cond_signal(&counter_cv);
-	pthread_mutex_unlock(&lock);
+	__atomic_sub_fetch(&thread_counter, 1, __ATOMIC_RELAXED);
+	sem_post(&threads_done);
 	pthread_exit(NULL);
 }
 
@@ -195,35 +230,47 @@ void signalHandler() {}
 
 
 /*
- * Listens for clients sessions, gets from each client a string and returns
- * the number of printable characters in it. Keeps statistic of total number
- * of bytes seen and number of appearances of each printable character.
- *
- * For each client session opens a new thread.
- *
- * On SIGINT (ctrl+c) stops listening for new clients, waits for all threads
- * to terminate, and prints statistics
+ * Returns number of cores available to the server (at most MAX_NUM_LOOPS)
  */
-int main (int argc, char* argv[]) {
-	// register signal handler
-	struct sigaction new_action;
-	sigemptyset(&new_action.sa_mask);
-	new_action.sa_sigaction = signalHandler;
-	new_action.sa_flags = SA_SIGINFO;
-	if (0 != sigaction(SIGINT, &new_action, NULL)) {
-		printf(SIG_REGISTER_ERROR, strerror(errno));
-		return -1;
+int getNumCores() {
+	int cores = 0;
+	cpu_set_t cpu_set;
+	if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+		cores = CPU_COUNT(&cpu_set);
+	if (cores <= 0)
+		cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cores <= 0)
+		cores = 1;
+	return cores < MAX_NUM_LOOPS ? cores : MAX_NUM_LOOPS;
+}
+
+
+/*
+ * Raises open files limit to its maximum, so the server can hold
+ * tens of thousands of connections
+ */
+void raiseFileLimit() {
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
 	}
+}
 
-	// setup listener
-	int listenfd = setupListener(SERVER_PORT);
-	if (listenfd == -1)
-		return -1;
-	printf(SERVER_UP_MSG);
 
-	// setup locks
-	pthread_mutex_init(&lock, NULL);
-	pthread_cond_init (&counter_cv, NULL);
+/*
+ * Accepts clients and opens a new (detached) thread for each client session.
+ * Breaks on SIGINT or error and waits for all threads to terminate.
+ * Returns 0 on success, -1 on failure
+ */
+int runThreads(int listenfd) {
+	int ret = 0, num_threads = 0;
+	sem_init(&threads_done, 0, 0);
+
+	// threads are never joined - detach them so their stacks are released on exit
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
 	// accept and create thread loop - breaks on SIGINT or error
 	pthread_t thread;
@@ -233,43 +280,154 @@ int main (int argc, char* argv[]) {
 		int* connfd_ptr = (int*) malloc(sizeof(int));
 		if (!connfd_ptr) {
 			printf(ALLOCATION_ERROR);
+			ret = -1;
 			break;
 		}
 
 		// accept
 		*connfd_ptr = accept(listenfd, NULL, NULL);
 		if(*connfd_ptr < 0) {
-			if (errno != 4) // do not print error on SIGINT
+			if (errno != EINTR) { // do not print error on SIGINT
 				printf(ACCEPT_ERROR, strerror(errno));
+				ret = -1;
+			}
 			free(connfd_ptr);
 			break;
 		}
 
-		// create thread
-		if (pthread_create(&thread, NULL, handleClient, (void *) connfd_ptr)) {
+		// raise thread counter and create thread
+		__atomic_add_fetch(&thread_counter, 1, __ATOMIC_RELAXED);
+		if (pthread_create(&thread, &attr, handleClient, (void *) connfd_ptr)) {
 			printf(THREAD_CREATE_ERROR);
+			__atomic_sub_fetch(&thread_counter, 1, __ATOMIC_RELAXED);
 			close(*connfd_ptr);
 			free(connfd_ptr);
+			ret = -1;
 			break;
 		}
+		num_threads++;
 	}
 	close(listenfd);
+	pthread_attr_destroy(&attr);
 
-	// wait for all threads to terminate and prints output stats
-	pthread_mutex_lock(&lock);
-	printf (SERVER_DOWN_MSG, thread_counter);
-	while (thread_counter > 0) // wait
-		pthread_cond_wait(&counter_cv, &lock);
-	// print stats
-	printf(STATS_COUNTER_MSG, global_bytes_read);
-	printf(STATS_HEADER_MSG);
-	for (int i=0; i < NUM_CHARS; i++)
-		if (isprint(i)) printf(STATS_DATA_MSG, i, global_stats[i]);
-	pthread_mutex_unlock(&lock);
+	// wait for all threads to terminate - each posts once
+	printf (SERVER_DOWN_MSG, __atomic_load_n(&thread_counter, __ATOMIC_RELAXED));
+	for (int i=0; i < num_threads; i++)
+		while (sem_wait(&threads_done) != 0 && errno == EINTR);
+	sem_destroy(&threads_done);
+
+	return ret;
+}
 
-	// destroy locks
-	pthread_mutex_destroy(&lock);
-	pthread_cond_destroy(&counter_cv);
 
-	return 0;
+/*
+ * Listens for clients sessions, gets from each client a string and returns
+ * the number of printable characters in it. Keeps statistic of total number
+ * of bytes seen and number of appearances of each printable character.
+ *
+ * By default serves clients with one epoll event loop per core, each with
+ * its own SO_REUSEPORT listener (-l sets number of loops).
+ * With -p hands client sessions to a fixed pool of worker threads
+ * (-w sets number of workers, defaults to number of cores).
+ * With -t opens a new thread for each client session instead.
+ *
+ * On SIGINT (ctrl+c) stops listening for new clients, waits for all open
+ * sessions to finish, and prints statistics
+ */
+int main (int argc, char* argv[]) {
+	// parse options
+	int use_threads = 0, use_pool = 0, num_loops = 0, num_workers = 0, opt;
+	while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+		switch (opt) {
+		case 't':
+			use_threads = 1;
+			break;
+		case 'l':
+			num_loops = parseCount(optarg, MAX_NUM_LOOPS);
+			if (num_loops == -1) {
+				printf(LOOPS_ERROR, optarg);
+				return -1;
+			}
+			break;
+		case 'p':
+			use_pool = 1;
+			break;
+		case 'w':
+			num_workers = parseCount(optarg, MAX_NUM_WORKERS);
+			if (num_workers == -1) {
+				printf(WORKERS_ERROR, optarg);
+				return -1;
+			}
+			break;
+		case 'b':
+			buffer_size = parseSize(optarg);
+			if (buffer_size <= 0) {
+				printf(SIZE_ERROR, optarg);
+				return -1;
+			}
+			break;
+		case 's':
+			socket_buffer_size = parseSize(optarg);
+			if (socket_buffer_size <= 0) {
+				printf(SIZE_ERROR, optarg);
+				return -1;
+			}
+			break;
+		default:
+			printf(USAGE_ERROR);
+			return -1;
+		}
+	}
+	if (!num_loops)
+		num_loops = getNumCores();
+	if (!num_workers)
+		num_workers = getNumCores();
+
+	// register signal handler
+	struct sigaction new_action;
+	sigemptyset(&new_action.sa_mask);
+	new_action.sa_sigaction = signalHandler;
+	new_action.sa_flags = SA_SIGINFO;
+	if (0 != sigaction(SIGINT, &new_action, NULL)) {
+		printf(SIG_REGISTER_ERROR, strerror(errno));
+		return -1;
+	}
+
+	int ret;
+	if (use_threads) {
+		// setup listener
+		int listenfd = setupListener(SERVER_PORT, 0, NUM_LISTENERS);
+		if (listenfd == -1)
+			return -1;
+		printf(SERVER_UP_MSG);
+		ret = runThreads(listenfd);
+	}
+	else if (use_pool) {
+		// setup listener - connections beyond the pool queues wait in its backlog
+		int listenfd = setupListener(SERVER_PORT, 0, SOMAXCONN);
+		if (listenfd == -1)
+			return -1;
+		raiseFileLimit();
+		printf(SERVER_UP_MSG);
+		ret = runPool(listenfd, num_workers, transaction);
+	}
+	else {
+		// setup one listener per event loop
+		int listenfds[MAX_NUM_LOOPS];
+		for (int i=0; i < num_loops; i++) {
+			listenfds[i] = setupListener(SERVER_PORT, 1, SOMAXCONN);
+			if (listenfds[i] == -1) {
+				for (int j=0; j < i; j++)
+					close(listenfds[j]);
+				return -1;
+			}
+		}
+		raiseFileLimit();
+		printf(SERVER_UP_MSG);
+		ret = runReactor(listenfds, num_loops, buffer_size);
+	}
+
+	// print stats
+	printStats();
+	return ret;
 }
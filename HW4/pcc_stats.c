@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pcc_stats.h"
+
+// output messages
+#define STATS_COUNTER_MSG "Total bytes read: %lld\n"
+#define STATS_HEADER_MSG "CHAR\tSTATS\n"
+#define STATS_DATA_MSG "%c\t%lld\n"
+
+// consts
+#define CACHE_LINE_SIZE 64
+#define PRINTABLE_FIRST 0x20	// ' ' - printable range of the "C" locale
+#define PRINTABLE_LAST 0x7E		// '~'
+#define BYTE_VALUES 256
+#define STATS_BANKS 4
+#define STATS_BANK_MIN_BYTES 4096			// below this banks cost more to set up than they save
+#define STATS_FLUSH_BYTES (1LL << 30)		// keeps 32 bit bank counters from overflowing
+
+typedef struct statsShard {
+	long long stats[NUM_CHARS];
+	long long bytes_read;
+} __attribute__((aligned(CACHE_LINE_SIZE))) statsShard;
+
+// global variables
+statsShard global_stats[NUM_STATS_SHARDS];
+
+
+/*
+ * Small buffer kernel - branch-free classification straight into stats.
+ * Non printable bytes add 0 to a masked (always in range) entry.
+ */
+static long long countPrintableDirect(const unsigned char* buffer, long long len, long long* stats) {
+	long long printable_bytes = 0;
+	for (long long i=0; i < len; i++) {
+		unsigned char c = buffer[i];
+		int printable = (unsigned char) (c - PRINTABLE_FIRST) <= PRINTABLE_LAST - PRINTABLE_FIRST;
+		printable_bytes += printable;
+		stats[c & (NUM_CHARS - 1)] += printable;
+	}
+	return printable_bytes;
+}
+
+
+/*
+ * Histogram kernel - each of 4 consecutive bytes goes to its own sub-histogram,
+ * so runs of equal bytes do not wait on each other's increments
+ */
+static void countBanks(const unsigned char* buffer, long long len, uint32_t banks[][BYTE_VALUES]) {
+	long long i = 0;
+	for (; len - i >= STATS_BANKS; i += STATS_BANKS) {
+		banks[0][buffer[i]]++;
+		banks[1][buffer[i+1]]++;
+		banks[2][buffer[i+2]]++;
+		banks[3][buffer[i+3]]++;
+	}
+	for (; i < len; i++)
+		banks[0][buffer[i]]++;
+}
+
+
+/*
+ * Counts printable bytes and updates stats.
+ * Large buffers are histogrammed over all 256 byte values and only the
+ * printable range is summed, which both classifies and counts the bytes.
+ */
+long long countPrintable(const char* buffer, long long len, long long* stats) {
+	const unsigned char* bytes = (const unsigned char*) buffer;
+	if (len < STATS_BANK_MIN_BYTES)
+		return countPrintableDirect(bytes, len, stats);
+
+	long long printable_bytes = 0;
+	uint32_t banks[STATS_BANKS][BYTE_VALUES];
+	for (long long offset = 0; offset < len; offset += STATS_FLUSH_BYTES) {
+		long long segment = len - offset;
+		if (segment > STATS_FLUSH_BYTES) segment = STATS_FLUSH_BYTES;
+
+		memset(banks, 0, sizeof(banks));
+		countBanks(bytes + offset, segment, banks);
+		for (int c = PRINTABLE_FIRST; c <= PRINTABLE_LAST; c++) {
+			long long count = 0;
+			for (int b=0; b < STATS_BANKS; b++)
+				count += banks[b][c];
+			stats[c] += count;
+			printable_bytes += count;
+		}
+	}
+	return printable_bytes;
+}
+
+
+/*
+ * Adds transaction stats to a global stats shard
+ */
+void addStats(int shard, const long long* stats, long long bytes_read) {
+	statsShard* dest = &global_stats[(unsigned) shard % NUM_STATS_SHARDS];
+	for (int i=0; i<NUM_CHARS; i++)
+		if (stats[i])
+			__atomic_fetch_add(&dest->stats[i], stats[i], __ATOMIC_RELAXED);
+	__atomic_fetch_add(&dest->bytes_read, bytes_read, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Prints global stats
+ */
+void printStats() {
+	long long stats[NUM_CHARS] = {0};
+	long long bytes_read = 0;
+	for (int shard=0; shard < NUM_STATS_SHARDS; shard++) {
+		for (int i=0; i < NUM_CHARS; i++)
+			stats[i] += __atomic_load_n(&global_stats[shard].stats[i], __ATOMIC_RELAXED);
+		bytes_read += __atomic_load_n(&global_stats[shard].bytes_read, __ATOMIC_RELAXED);
+	}
+
+	printf(STATS_COUNTER_MSG, bytes_read);
+	printf(STATS_HEADER_MSG);
+	for (int i=0; i < NUM_CHARS; i++)
+		if (isprint(i)) printf(STATS_DATA_MSG, i, stats[i]);
+}
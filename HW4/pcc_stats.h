@@ -0,0 +1,31 @@
+#ifndef PCC_STATS_H_
+#define PCC_STATS_H_
+
+// consts
+#define NUM_CHARS 128
+#define NUM_STATS_SHARDS 64
+
+/*
+ * Counts printable bytes in buffer and adds their appearances to stats
+ * @param stats - per character counters (NUM_CHARS entries)
+ * @return number of printable bytes in buffer
+ */
+long long countPrintable(const char* buffer, long long len, long long* stats);
+
+/*
+ * Merges statistics of finished transactions into the global statistics.
+ * Global statistics are split into cache line aligned shards updated with
+ * relaxed atomic adds, so threads adding to different shards never contend.
+ * @param shard - shard to add to (taken modulo NUM_STATS_SHARDS), e.g. worker id
+ * @param stats - per character counters (NUM_CHARS entries)
+ * @param bytes_read - number of bytes read in these transactions
+ */
+void addStats(int shard, const long long* stats, long long bytes_read);
+
+/*
+ * Prints total number of bytes read and appearances of each printable character
+ * (sums all shards)
+ */
+void printStats();
+
+#endif /* PCC_STATS_H_ */
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "pcc_util.h"
+
+
+/*
+ * Parses a positive size with an optional K/M/G suffix
+ */
+long long parseSize(char* str) {
+	char* end;
+	errno = 0;
+	long long size = strtoll(str, &end, 10);
+	if (end == str || errno == ERANGE || size <= 0)
+		return -1;
+	long long multiplier = 1;
+	switch (*end) {
+	case 'G': case 'g': multiplier *= 1024;
+	// fall through
+	case 'M': case 'm': multiplier *= 1024;
+	// fall through
+	case 'K': case 'k': multiplier *= 1024;
+		end++;
+	}
+	// checked before multiplying - an overflowed size could wrap back under the cap
+	return *end == '\0' && size <= INT_MAX / multiplier ? size * multiplier : -1;
+}
+
+
+/*
+ * Parses a positive integer of at most max
+ */
+int parseCount(char* str, int max) {
+	char* end;
+	errno = 0;
+	long count = strtol(str, &end, 10);
+	if (end == str || *end != '\0' || errno == ERANGE || count <= 0 || count > max)
+		return -1;
+	return (int) count;
+}
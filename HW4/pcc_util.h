@@ -0,0 +1,16 @@
+#ifndef PCC_UTIL_H_
+#define PCC_UTIL_H_
+
+/*
+ * Parses a positive size with an optional K/M/G suffix (shared by server and client)
+ * @return size, -1 if not a valid size (or larger than 2G)
+ */
+long long parseSize(char* str);
+
+/*
+ * Parses a positive integer of at most max - no suffixes, e.g. a thread count
+ * @return number, -1 if not a valid number
+ */
+int parseCount(char* str, int max);
+
+#endif /* PCC_UTIL_H_ */